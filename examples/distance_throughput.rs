@@ -0,0 +1,229 @@
+// time `EuclWithScaledPt::distance` against a simple reference
+// implementation, evaluated once with noisy_float's N64 and once with
+// plain f64 arithmetic
+// run with `cargo run --release --example distance_throughput -- [NEVENTS]`
+use std::ops::{Add, AddAssign, Mul, Sub};
+use std::time::{Duration, Instant};
+
+use cres::distance::{Distance, EuclWithScaledPt};
+use cres::event::{Event, EventBuilder, EventView};
+use cres::four_vector::FourVector;
+
+use noisy_float::prelude::*;
+use rand::distributions::{Distribution, Uniform};
+use rand::{Rng, SeedableRng};
+use rand_xoshiro::Xoshiro256Plus;
+
+const PT_WEIGHT: f64 = 0.5;
+const MAX_SET_SIZE: usize = 4;
+
+// events with one to four particles of each of two types
+fn random_event<R: Rng>(id: usize, rng: &mut R) -> Event {
+    let multiplicity = Uniform::from(1..=MAX_SET_SIZE);
+    let momentum = Uniform::from(-100.0..100.0);
+    let mut event = EventBuilder::new(id);
+    for pid in [21, 22] {
+        for _ in 0..multiplicity.sample(rng) {
+            let p: [f64; 3] = std::array::from_fn(|_| momentum.sample(rng));
+            let e = (p[0] * p[0] + p[1] * p[1] + p[2] * p[2]).sqrt();
+            event.add_outgoing(
+                pid,
+                [n64(e), n64(p[0]), n64(p[1]), n64(p[2])].into(),
+            );
+        }
+    }
+    event.weight(n64(1.));
+    event.build()
+}
+
+// the arithmetic needed by the reference implementation
+trait Real:
+    Copy
+    + PartialOrd
+    + Add<Output = Self>
+    + Sub<Output = Self>
+    + Mul<Output = Self>
+    + AddAssign
+{
+    fn from_n64(x: N64) -> Self;
+    fn to_f64(self) -> f64;
+    fn sqrt(self) -> Self;
+    fn infinity() -> Self;
+}
+
+impl Real for f64 {
+    fn from_n64(x: N64) -> Self {
+        x.raw()
+    }
+
+    fn to_f64(self) -> f64 {
+        self
+    }
+
+    fn sqrt(self) -> Self {
+        f64::sqrt(self)
+    }
+
+    fn infinity() -> Self {
+        f64::INFINITY
+    }
+}
+
+impl Real for N64 {
+    fn from_n64(x: N64) -> Self {
+        x
+    }
+
+    fn to_f64(self) -> f64 {
+        self.raw()
+    }
+
+    fn sqrt(self) -> Self {
+        N64::sqrt(self)
+    }
+
+    fn infinity() -> Self {
+        N64::infinity()
+    }
+}
+
+fn pair_distance<T: Real>(p: &FourVector, q: &FourVector, tau: T) -> T {
+    let [p, q] = [p, q].map(|p| [1, 2, 3].map(|i| T::from_n64(p[i])));
+    let [pt_p, pt_q] = [p, q].map(|p| (p[0] * p[0] + p[1] * p[1]).sqrt());
+    let d = [0, 1, 2].map(|i| p[i] - q[i]);
+    let pt = tau * (pt_p - pt_q);
+    (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + pt * pt).sqrt()
+}
+
+// minimum over the pairings of rows `i..` with the unused columns
+fn min_rest<T: Real>(cost: &[[T; MAX_SET_SIZE]], i: usize, used: u32) -> T {
+    if i == cost.len() {
+        return T::from_n64(n64(0.));
+    }
+    let mut min = T::infinity();
+    for j in 0..cost.len() {
+        if used & (1 << j) == 0 {
+            let dist = cost[i][j] + min_rest(cost, i + 1, used | (1 << j));
+            if dist < min {
+                min = dist;
+            }
+        }
+    }
+    min
+}
+
+// minimum over all pairings, padding the smaller set with zero momenta
+fn min_paired_distance<T: Real>(
+    p1: &[FourVector],
+    p2: &[FourVector],
+    tau: T,
+) -> T {
+    let n = std::cmp::max(p1.len(), p2.len());
+    assert!(n <= MAX_SET_SIZE);
+    let zero = FourVector::new();
+    let mut cost = [[T::from_n64(n64(0.)); MAX_SET_SIZE]; MAX_SET_SIZE];
+    for (i, row) in cost[..n].iter_mut().enumerate() {
+        let p = p1.get(i).unwrap_or(&zero);
+        for (j, cost) in row[..n].iter_mut().enumerate() {
+            *cost = pair_distance(p, p2.get(j).unwrap_or(&zero), tau);
+        }
+    }
+    min_rest(&cost[..n], 0, 0)
+}
+
+fn reference_distance<T: Real>(ev1: EventView, ev2: EventView, tau: T) -> T {
+    let zero = FourVector::new();
+    let norm = |p: &[FourVector]| {
+        let mut norm = T::from_n64(n64(0.));
+        for p in p {
+            norm += pair_distance(p, &zero, tau);
+        }
+        norm
+    };
+    let mut out1 = ev1.outgoing().peekable();
+    let mut out2 = ev2.outgoing().peekable();
+    let mut dist = T::from_n64(n64(0.));
+    loop {
+        match (out1.peek(), out2.peek()) {
+            (Some((t1, p1)), Some((t2, p2))) => match t1.cmp(t2) {
+                std::cmp::Ordering::Greater => {
+                    dist += norm(p1);
+                    out1.next();
+                }
+                std::cmp::Ordering::Less => {
+                    dist += norm(p2);
+                    out2.next();
+                }
+                std::cmp::Ordering::Equal => {
+                    dist += min_paired_distance(p1, p2, tau);
+                    out1.next();
+                    out2.next();
+                }
+            },
+            (Some((_, p1)), None) => {
+                dist += norm(p1);
+                out1.next();
+            }
+            (None, Some((_, p2))) => {
+                dist += norm(p2);
+                out2.next();
+            }
+            (None, None) => return dist,
+        }
+    }
+}
+
+// all pairwise distances and the time per distance
+fn time_distances<F: Fn(EventView, EventView) -> f64>(
+    events: &[Event],
+    distance: F,
+) -> (Vec<f64>, Duration) {
+    let start = Instant::now();
+    let mut dists = Vec::with_capacity(events.len() * events.len());
+    for ev1 in events {
+        for ev2 in events {
+            dists.push(distance(ev1.view(), ev2.view()));
+        }
+    }
+    let time = start.elapsed() / dists.len() as u32;
+    (dists, time)
+}
+
+fn max_relative_deviation(dists: &[f64], reference: &[f64]) -> f64 {
+    dists
+        .iter()
+        .zip(reference)
+        .filter(|(_, r)| **r > 0.)
+        .map(|(d, r)| ((d - r) / r).abs())
+        .fold(0., f64::max)
+}
+
+fn main() {
+    let nevents = std::env::args()
+        .nth(1)
+        .map(|n| n.parse().unwrap())
+        .unwrap_or(1000);
+    let mut rng = Xoshiro256Plus::seed_from_u64(0);
+    let events: Vec<_> =
+        (0..nevents).map(|id| random_event(id, &mut rng)).collect();
+
+    let tau = n64(PT_WEIGHT);
+    let (reference, n64_time) = time_distances(&events, |ev1, ev2| {
+        reference_distance(ev1, ev2, tau).to_f64()
+    });
+    let (f64_dists, f64_time) = time_distances(&events, |ev1, ev2| {
+        reference_distance(ev1, ev2, tau.raw())
+    });
+    let distance = EuclWithScaledPt::new(tau);
+    let (dists, time) =
+        time_distances(&events, |ev1, ev2| distance.distance(ev1, ev2).raw());
+
+    println!("reference with N64: {:?} per distance", n64_time);
+    println!("reference with f64: {:?} per distance", f64_time);
+    println!("EuclWithScaledPt: {:?} per distance", time);
+    println!(
+        "maximum relative deviation from the reference: {:e}",
+        max_relative_deviation(&dists, &reference)
+    );
+    assert_eq!(f64_dists, reference);
+}
@@ -4,7 +4,7 @@
 use std::error::Error;
 
 use cres::distance::Distance;
-use cres::event::Event;
+use cres::event::EventView;
 use cres::hepmc2::{Converter, Reader, WriterBuilder};
 use cres::prelude::*;
 
@@ -18,12 +18,12 @@ struct MyDistance {
 }
 
 impl Distance for MyDistance {
-    fn distance(&self, ev1: &Event, ev2: &Event) -> N64 {
+    fn distance(&self, ev1: EventView, ev2: EventView) -> N64 {
         if ev1.outgoing().len() != ev2.outgoing().len() {
             return N64::infinity();
         }
         let mut dist = n64(0.);
-        let set_pairs = ev1.outgoing().iter().zip(ev2.outgoing().iter());
+        let set_pairs = ev1.outgoing().zip(ev2.outgoing());
         for ((id1, s1), (id2, s2)) in set_pairs {
             if id1 != id2 || s1.len() != s2.len() {
                 return N64::infinity();
@@ -30,7 +30,12 @@ fn main() -> Result<()> {
 
     let mut resampler = DefaultResamplerBuilder::default();
     resampler
+        .concurrent_cells(opt.concurrent_cells)
+        .distance_cache(opt.distance_cache)
+        .epsilon(opt.epsilon)
+        .exact_pairing(opt.exact_pairing)
         .max_cell_size(opt.max_cell_size)
+        .neighbour_search(opt.neighbour_search)
         .ptweight(opt.ptweight)
         .strategy(opt.strategy)
         .weight_norm(opt.weight_norm);
@@ -59,7 +64,9 @@ fn main() -> Result<()> {
         unweighter: Unweighter::new(opt.unweight.minweight, rng),
         writer,
     }
-    .build();
+    .build()
+    .memory_limit(opt.memory_limit)
+    .precision(opt.precision);
     cres.run()?;
     info!("done");
     Ok(())
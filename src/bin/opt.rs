@@ -2,7 +2,9 @@ use std::fmt::{self, Display};
 use std::path::PathBuf;
 
 use cres::compression::Compression;
+use cres::event_store::Precision;
 use cres::hepmc2::converter::JetAlgorithm;
+use cres::resampler::NeighbourSearch;
 use cres::seeds::Strategy;
 
 use lazy_static::lazy_static;
@@ -29,6 +31,77 @@ impl Display for UnknownStrategy {
     }
 }
 
+fn parse_neighbour_search(
+    s: &str,
+) -> Result<NeighbourSearch, UnknownNeighbourSearch> {
+    use NeighbourSearch::*;
+    match s {
+        "Naive" | "naive" => Ok(Naive),
+        "Tree" | "tree" => Ok(Tree),
+        "Pivots" | "pivots" => Ok(Pivots),
+        "Buckets" | "buckets" => Ok(Buckets),
+        "Graph" | "graph" => Ok(Graph),
+        "MixedPrecision" | "mixed" => Ok(MixedPrecision),
+        _ => Err(UnknownNeighbourSearch(s.to_string())),
+    }
+}
+
+#[derive(Debug, Clone, Error)]
+#[error("Unknown neighbour search: {0}")]
+pub struct UnknownNeighbourSearch(pub String);
+
+fn parse_precision(s: &str) -> Result<Precision, UnknownPrecision> {
+    use Precision::*;
+    match s {
+        "Double" | "double" => Ok(Double),
+        "Single" | "single" => Ok(Single),
+        "Half" | "half" => Ok(Half),
+        _ => Err(UnknownPrecision(s.to_string())),
+    }
+}
+
+#[derive(Debug, Clone, Error)]
+#[error("Unknown precision: {0}")]
+pub struct UnknownPrecision(pub String);
+
+fn parse_memory_size(s: &str) -> Result<usize, ParseMemorySizeErr> {
+    let (num, unit) = match s.find(|c: char| c.is_ascii_alphabetic()) {
+        Some(pos) => s.split_at(pos),
+        None => (s, ""),
+    };
+    let factor: usize = match unit.to_ascii_uppercase().as_str() {
+        "" | "B" => 1,
+        "K" | "KB" => 1 << 10,
+        "M" | "MB" => 1 << 20,
+        "G" | "GB" => 1 << 30,
+        "T" | "TB" => 1 << 40,
+        _ => return Err(ParseMemorySizeErr(s.to_owned())),
+    };
+    let num: f64 = num
+        .trim()
+        .parse()
+        .map_err(|_| ParseMemorySizeErr(s.to_owned()))?;
+    if num < 0. {
+        return Err(ParseMemorySizeErr(s.to_owned()));
+    }
+    Ok((num * factor as f64) as usize)
+}
+
+#[derive(Debug, Clone, Error)]
+#[error("Invalid memory size: {0}")]
+pub struct ParseMemorySizeErr(pub String);
+
+fn parse_epsilon(s: &str) -> Result<f64, ParseEpsilonErr> {
+    match s.trim().parse::<f64>() {
+        Ok(epsilon) if epsilon.is_finite() && epsilon >= 0. => Ok(epsilon),
+        _ => Err(ParseEpsilonErr(s.to_owned())),
+    }
+}
+
+#[derive(Debug, Clone, Error)]
+#[error("Invalid epsilon: {0}, has to be a finite non-negative number")]
+pub struct ParseEpsilonErr(pub String);
+
 #[derive(Debug, Clone, Error)]
 pub(crate) enum ParseCompressionErr {
     #[error("Unknown compression algorithm: {0}")]
@@ -172,6 +245,14 @@ when calculating particle momentum distances.\n"
     )]
     pub(crate) ptweight: f64,
 
+    #[structopt(
+        long,
+        help = "Always find the optimal pairing of particles.
+By default, particle types with at least eight particles
+are paired greedily, which can overestimate distances."
+    )]
+    pub(crate) exact_pairing: bool,
+
     #[structopt(
         short = "n",
         long,
@@ -220,6 +301,70 @@ left-over negative-weight events."
     )]
     pub(crate) max_cell_size: Option<f64>,
 
+    #[structopt(
+        long, default_value = "naive",
+        parse(try_from_str = parse_neighbour_search),
+        help = "Algorithm for finding the nearest neighbours of cell seeds.
+Possible values are
+'naive': compute the distances to all events,
+'tree': use a vantage-point tree,
+'pivots': skip distance computations using distances to pivot events,
+'buckets': group events by particle content and skip distant groups,
+'graph': precompute the nearest neighbours of all negative-weight events,
+'mixed': rank events by their distance in single precision.\n"
+    )]
+    pub(crate) neighbour_search: NeighbourSearch,
+
+    #[structopt(
+        long,
+        default_value = "0",
+        parse(try_from_str = parse_epsilon),
+        help = "Allowed relative error ε for approximate nearest neighbours.
+Cell members can be up to a factor 1+ε farther away from the seed
+than the exact nearest neighbours. Only used for the 'tree', 'pivots',
+and 'buckets' neighbour searches."
+    )]
+    pub(crate) epsilon: f64,
+
+    #[structopt(
+        long,
+        default_value = "1",
+        help = "Number of cells to construct concurrently.
+Cells overlapping with earlier ones are constructed again,
+so the result does not depend on this setting."
+    )]
+    pub(crate) concurrent_cells: usize,
+
+    #[structopt(
+        long,
+        parse(try_from_str = parse_memory_size),
+        help = "Maximum memory used for storing events, e.g. '16G'.
+Events exceeding the limit are moved to a temporary file."
+    )]
+    pub(crate) memory_limit: Option<usize>,
+
+    #[structopt(
+        long, default_value = "double",
+        parse(try_from_str = parse_precision),
+        help = "Precision for storing particle momenta.
+Possible values are
+'double': full double precision,
+'single': single precision,
+'half': 16-bit integers relative to the largest momentum in each event.
+Lower precision reduces memory usage, but changes the distances.
+With 'single' and 'half', event ids have to be below 2^32.\n"
+    )]
+    pub(crate) precision: Precision,
+
+    #[structopt(
+        long,
+        parse(try_from_str = parse_memory_size),
+        help = "Maximum memory used for caching distances between events,
+e.g. '1G'. Only used with the 'tree', 'pivots', and 'graph' neighbour searches.
+By default, no distances are cached."
+    )]
+    pub(crate) distance_cache: Option<usize>,
+
     /// Input files
     #[structopt(name = "INFILES", parse(from_os_str))]
     pub(crate) infiles: Vec<PathBuf>,
@@ -1,6 +1,6 @@
-use crate::c_api::distance::DistanceFn;
+use crate::c_api::distance::{BatchedDistanceFn, DistanceFn};
 use crate::c_api::error::LAST_ERROR;
-use crate::distance::EuclWithScaledPt;
+use crate::distance::{Distance, EuclWithScaledPt};
 use crate::hepmc2;
 use crate::prelude::{CresBuilder, NO_UNWEIGHTING};
 use crate::resampler::ResamplerBuilder;
@@ -103,7 +103,35 @@ impl From<JetAlgorithm> for hepmc2::converter::JetAlgorithm {
 #[no_mangle]
 #[must_use]
 pub extern "C" fn cres_run(opt: &Opt) -> i32 {
-    match std::panic::catch_unwind(|| cres_run_internal(opt)) {
+    catch_errors(|| cres_run_internal(opt))
+}
+
+/// Run the cell resampler with a batched distance function
+///
+/// This is the same as `cres_run`, except that `distance` is used as
+/// the distance function. The `distance` member of `opt` is ignored.
+///
+/// # Return values
+///
+/// - `0`: success
+/// - Non-zero: an error occurred, check with `cres_get_last_err` or
+///   `cres_print_last_err`
+#[no_mangle]
+#[must_use]
+pub extern "C" fn cres_run_with_batched_distance(
+    opt: &Opt,
+    distance: &BatchedDistanceFn,
+) -> i32 {
+    catch_errors(|| {
+        debug!("Using custom batched distance function {:?}", distance);
+        run_with_distance(opt, *distance)
+    })
+}
+
+fn catch_errors(
+    f: impl FnOnce() -> Result<(), Error> + std::panic::UnwindSafe,
+) -> i32 {
+    match std::panic::catch_unwind(f) {
         Ok(Ok(())) => 0,
         Ok(Err(err)) => {
             LAST_ERROR.with(|e| *e.borrow_mut() = Some(err));
@@ -118,6 +146,20 @@ pub extern "C" fn cres_run(opt: &Opt) -> i32 {
 }
 
 fn cres_run_internal(opt: &Opt) -> Result<(), Error> {
+    if !opt.distance.is_null() {
+        let distance = unsafe { *opt.distance };
+        debug!("Using custom distance function {:?}", distance);
+        run_with_distance(opt, distance)
+    } else {
+        debug!("Using built-in distance function");
+        run_with_distance(opt, EuclWithScaledPt::new(n64(opt.ptweight)))
+    }
+}
+
+fn run_with_distance<D>(opt: &Opt, distance: D) -> Result<(), Error>
+where
+    D: Distance + Send + Sync,
+{
     debug!("Settings: {:#?}", opt);
 
     let infiles: Vec<_> = unsafe {
@@ -151,39 +193,19 @@ fn cres_run_internal(opt: &Opt) -> Result<(), Error> {
     // TODO: seeds, observer
     let resampler = ResamplerBuilder::default()
         .weight_norm(opt.weight_norm)
-        .max_cell_size(Some(opt.max_cell_size as f64));
-
-    // TODO: code duplication
-    if !opt.distance.is_null() {
-        let distance = unsafe { *opt.distance };
-        debug!("Using custom distance function {:?}", distance);
-        let resampler = resampler.distance(distance).build();
-        let mut cres = CresBuilder {
-            reader,
-            converter,
-            resampler,
-            unweighter,
-            writer,
-        }
-        .build();
-        debug!("Starting resampler");
-        cres.run()?;
-    } else {
-        debug!("Using built-in distance function");
-        let resampler = resampler
-            .distance(EuclWithScaledPt::new(n64(opt.ptweight)))
-            .build();
-        let mut cres = CresBuilder {
-            reader,
-            converter,
-            resampler,
-            unweighter,
-            writer,
-        }
+        .max_cell_size(Some(opt.max_cell_size as f64))
+        .distance(distance)
         .build();
-        debug!("Starting resampler");
-        cres.run()?;
+    let mut cres = CresBuilder {
+        reader,
+        converter,
+        resampler,
+        unweighter,
+        writer,
     }
+    .build();
+    debug!("Starting resampler");
+    cres.run()?;
 
     Ok(())
 }
@@ -1,5 +1,5 @@
-use crate::c_api::event::{EventView, TypeSet};
-use crate::event::Event;
+use crate::c_api::event::{EventView, TypeSet, TypeSetView};
+use crate::event;
 use crate::traits::Distance;
 
 use std::ffi::c_void;
@@ -37,36 +37,159 @@ unsafe impl Send for DistanceFn {}
 unsafe impl Sync for DistanceFn {}
 
 impl Distance for DistanceFn {
-    fn distance(&self, ev1: &Event, ev2: &Event) -> N64 {
+    fn distance(
+        &self,
+        ev1: event::EventView<'_>,
+        ev2: event::EventView<'_>,
+    ) -> N64 {
         trace!("Compute distance between {:?} and {:?}", ev1, ev2);
         let type_sets1 = extract_typesets(ev1);
         let type_set_views1: Vec<_> =
             type_sets1.iter().map(TypeSet::view).collect();
-        let event_view1 = EventView {
-            id: ev1.id(),
-            weight: ev1.weight.into(),
-            type_sets: type_set_views1.as_ptr(),
-            n_type_sets: type_set_views1.len(),
-        };
+        let event_view1 = event_view(ev1, &type_set_views1);
         let type_sets2 = extract_typesets(ev2);
         let type_set_views2: Vec<_> =
             type_sets2.iter().map(TypeSet::view).collect();
-        let event_view2 = EventView {
-            id: ev2.id(),
-            weight: ev2.weight.into(),
-            type_sets: type_set_views2.as_ptr(),
-            n_type_sets: type_set_views2.len(),
-        };
+        let event_view2 = event_view(ev2, &type_set_views2);
         let dist = unsafe { (self.fun)(self.data, &event_view1, &event_view2) };
         n64(dist)
     }
+
+    /// Distances between `seed` and each of the `events`
+    ///
+    /// The view of the seed is only constructed once.
+    fn distance_many(
+        &self,
+        seed: event::EventView<'_>,
+        events: &[event::EventView<'_>],
+        out: &mut [N64],
+    ) {
+        trace!("Compute distances to {} events", events.len());
+        debug_assert_eq!(events.len(), out.len());
+        with_views(seed, events, |seed_view, event_views| {
+            for (out, view) in out.iter_mut().zip(event_views) {
+                let dist = unsafe { (self.fun)(self.data, view, seed_view) };
+                *out = n64(dist);
+            }
+        })
+    }
 }
 
-fn extract_typesets(ev: &Event) -> Vec<TypeSet> {
-    ev.outgoing()
+/// User-defined distance function for many events at once
+///
+/// To use this, call `cres_run_with_batched_distance`.
+#[repr(C)]
+#[derive(Copy, Clone)]
+pub struct BatchedDistanceFn {
+    /// The distance function for a single pair of events
+    pub single: DistanceFn,
+    /// The distance function for many events
+    ///
+    /// This is used instead of `single` to compute the distances
+    /// between a seed event and a batch of events. The arguments are
+    /// the `data` member of `single`, the seed, an array of events, the
+    /// number of events, and an output array of the same length. The
+    /// function has to store the distance between the seed and each
+    /// event in the output array. The same requirements as for the
+    /// function in `single` apply.
+    pub fun_many: unsafe fn(
+        *mut c_void,
+        &EventView,
+        *const EventView,
+        usize,
+        *mut c_double,
+    ),
+}
+
+impl Debug for BatchedDistanceFn {
+    fn fmt(&self, f: &mut Formatter<'_>) -> fmt::Result {
+        let addr = self.fun_many as *const ();
+        f.debug_struct("BatchedDistanceFn")
+            .field("single", &self.single)
+            .field("fun_many", &addr)
+            .finish()
+    }
+}
+
+unsafe impl Send for BatchedDistanceFn {}
+unsafe impl Sync for BatchedDistanceFn {}
+
+impl Distance for BatchedDistanceFn {
+    fn distance(
+        &self,
+        ev1: event::EventView<'_>,
+        ev2: event::EventView<'_>,
+    ) -> N64 {
+        self.single.distance(ev1, ev2)
+    }
+
+    /// Distances between `seed` and each of the `events`
+    ///
+    /// `fun_many` is called once for all events.
+    fn distance_many(
+        &self,
+        seed: event::EventView<'_>,
+        events: &[event::EventView<'_>],
+        out: &mut [N64],
+    ) {
+        trace!("Compute distances to {} events", events.len());
+        debug_assert_eq!(events.len(), out.len());
+        let mut dists = vec![0.; events.len()];
+        with_views(seed, events, |seed_view, event_views| unsafe {
+            (self.fun_many)(
+                self.single.data,
+                seed_view,
+                event_views.as_ptr(),
+                event_views.len(),
+                dists.as_mut_ptr(),
+            )
+        });
+        for (out, dist) in out.iter_mut().zip(dists) {
+            *out = n64(dist);
+        }
+    }
+}
+
+/// Call `f` with the C views of `seed` and `events`
+fn with_views<R>(
+    seed: event::EventView<'_>,
+    events: &[event::EventView<'_>],
+    f: impl FnOnce(&EventView, &[EventView]) -> R,
+) -> R {
+    let seed_type_sets = extract_typesets(seed);
+    let seed_type_set_views: Vec<_> =
+        seed_type_sets.iter().map(TypeSet::view).collect();
+    let seed_view = event_view(seed, &seed_type_set_views);
+    let type_sets: Vec<_> =
+        events.iter().map(|ev| extract_typesets(*ev)).collect();
+    let type_set_views: Vec<Vec<_>> = type_sets
         .iter()
+        .map(|t| t.iter().map(TypeSet::view).collect())
+        .collect();
+    let event_views: Vec<_> = events
+        .iter()
+        .zip(&type_set_views)
+        .map(|(ev, views)| event_view(*ev, views))
+        .collect();
+    f(&seed_view, &event_views)
+}
+
+fn event_view<'a>(
+    ev: event::EventView<'_>,
+    type_sets: &'a [TypeSetView<'a>],
+) -> EventView<'a> {
+    EventView {
+        id: ev.id(),
+        weight: ev.weight.into(),
+        type_sets: type_sets.as_ptr(),
+        n_type_sets: type_sets.len(),
+    }
+}
+
+fn extract_typesets(ev: event::EventView<'_>) -> Vec<TypeSet> {
+    ev.outgoing()
         .map(|(id, p)| TypeSet {
-            pid: *id,
+            pid: id,
             momenta: p
                 .iter()
                 .map(|p| [p[0].into(), p[1].into(), p[2].into(), p[3].into()])
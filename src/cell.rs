@@ -1,5 +1,14 @@
+use crate::compact_events::CompactEvents;
 use crate::distance::Distance;
-use crate::event::Event;
+use crate::event::EventView;
+use crate::event_store::Events;
+use crate::knn_graph::KnnGraph;
+use crate::pivot_table::PivotTable;
+use crate::signature_buckets::SignatureBuckets;
+use crate::vp_tree::VpTree;
+
+use std::cell::RefCell;
+use std::collections::{BTreeSet, HashMap};
 
 use log::{debug, trace};
 use noisy_float::prelude::*;
@@ -8,62 +17,144 @@ use rayon::prelude::*;
 /// A cell
 ///
 /// See [arXiv:2109.07851](https://arxiv.org/abs/2109.07851) for details
+///
+/// The events can be any collection of [Events]. By default, they are
+/// accessed through a trait object, which is what
+/// [ObserveCell](crate::traits::ObserveCell) receives.
 #[derive(PartialEq, Eq, PartialOrd, Ord, Debug)]
-pub struct Cell<'a> {
-    events: &'a mut [(N64, Event)],
-    members: Vec<usize>,
+pub struct Cell<'a, E: ?Sized + 'a = dyn Events + 'a> {
+    events: &'a E,
+    weights: &'a mut [N64],
+    // (index, distance from the seed), starting with the seed
+    members: Vec<(usize, N64)>,
     radius: N64,
     weight_sum: N64,
 }
 
 /// Construct a new cell
 ///
-/// The `events` items have the form (N64, Event), where
-/// the first tuple element is used to store distances
-impl<'a> Cell<'a> {
+/// The current event weights are taken from `weights`, the weights
+/// stored in `events` are ignored.
+impl<'a, E: Events + ?Sized> Cell<'a, E> {
     pub fn new<'b: 'a, F: Distance + Sync + Send>(
-        events: &'b mut [(N64, Event)],
+        events: &'b E,
+        weights: &'b mut [N64],
         seed_idx: usize,
         distance: &F,
         max_size: N64,
     ) -> Self {
-        let mut weight_sum = events[seed_idx].1.weight;
-        debug_assert!(weight_sum < 0.);
-        debug!("Cell seed with weight {:e}", weight_sum);
-        let mut members = vec![seed_idx];
-        let seed = events[seed_idx].1.clone();
+        let members =
+            Members::naive(events, weights, seed_idx, distance, max_size);
+        Self::from_members(events, weights, members)
+    }
 
-        events
-            .par_iter_mut()
-            .for_each(|(dist, e)| *dist = distance.distance(e, &seed));
+    /// Construct a new cell using a [VpTree] to find nearest neighbours
+    ///
+    /// The result is the same as for [Cell::new], provided the
+    /// distance satisfies the triangle inequality. If the tree search
+    /// turns out to be more expensive than computing all distances
+    /// from the seed, we fall back to [Cell::new].
+    pub fn with_vp_tree<'b: 'a, F: Distance + Sync + Send>(
+        events: &'b E,
+        weights: &'b mut [N64],
+        seed_idx: usize,
+        distance: &F,
+        max_size: N64,
+        tree: &VpTree,
+    ) -> Self {
+        let members = Members::with_vp_tree(
+            events, weights, seed_idx, distance, max_size, tree,
+        );
+        Self::from_members(events, weights, members)
+    }
 
-        let mut candidates: Vec<_> = (0..events.len()).collect();
-        candidates.swap_remove(seed_idx);
+    /// Construct a new cell using a [PivotTable] to skip distance evaluations
+    ///
+    /// The result is the same as for [Cell::new], provided the
+    /// distance satisfies the triangle inequality.
+    pub fn with_pivot_table<'b: 'a, F: Distance + Sync + Send>(
+        events: &'b E,
+        weights: &'b mut [N64],
+        seed_idx: usize,
+        distance: &F,
+        max_size: N64,
+        pivots: &PivotTable,
+    ) -> Self {
+        let members = Members::with_pivot_table(
+            events, weights, seed_idx, distance, max_size, pivots,
+        );
+        Self::from_members(events, weights, members)
+    }
 
-        while weight_sum < 0. {
-            let nearest = candidates
-                .par_iter()
-                .enumerate()
-                .min_by_key(|(_pos, &idx)| events[idx].0);
-            if let Some((pos, &idx)) = nearest {
-                candidates.swap_remove(pos);
-                trace!(
-                    "adding event with distance {}, weight {:e} to cell",
-                    events[idx].0,
-                    events[idx].1.weight
-                );
-                if events[idx].0 > max_size {
-                    break;
-                }
-                weight_sum += events[idx].1.weight;
-                members.push(idx);
-            } else {
-                break;
-            };
-        }
-        let radius = events[*members.last().unwrap()].0;
+    /// Construct a new cell using [SignatureBuckets] to skip distance evaluations
+    ///
+    /// The result is the same as for [Cell::new].
+    pub fn with_signature_buckets<'b: 'a, F: Distance + Sync + Send>(
+        events: &'b E,
+        weights: &'b mut [N64],
+        seed_idx: usize,
+        distance: &F,
+        max_size: N64,
+        buckets: &SignatureBuckets,
+    ) -> Self {
+        let members = Members::with_signature_buckets(
+            events, weights, seed_idx, distance, max_size, buckets,
+        );
+        Self::from_members(events, weights, members)
+    }
+
+    /// Construct a new cell using precomputed neighbours from a [KnnGraph]
+    ///
+    /// The result is the same as for [Cell::new].
+    pub fn with_knn_graph<'b: 'a, F: Distance + Sync + Send>(
+        events: &'b E,
+        weights: &'b mut [N64],
+        seed_idx: usize,
+        distance: &F,
+        max_size: N64,
+        graph: &KnnGraph,
+    ) -> Self {
+        let members = Members::with_knn_graph(
+            events, weights, seed_idx, distance, max_size, graph,
+        );
+        Self::from_members(events, weights, members)
+    }
+
+    /// Construct a new cell using a single-precision copy of the events
+    /// in [CompactEvents] to skip distance evaluations
+    ///
+    /// The result is the same as for [Cell::new].
+    pub fn with_compact_events<'b: 'a, F: Distance + Sync + Send>(
+        events: &'b E,
+        weights: &'b mut [N64],
+        seed_idx: usize,
+        distance: &F,
+        max_size: N64,
+        compact: &CompactEvents,
+    ) -> Self {
+        let members = Members::with_compact_events(
+            events, weights, seed_idx, distance, max_size, compact,
+        );
+        Self::from_members(events, weights, members)
+    }
+
+    /// Construct a new cell from previously selected members
+    ///
+    /// The weights of the events in `members` must not have changed
+    /// since the selection.
+    pub fn from_members<'b: 'a>(
+        events: &'b E,
+        weights: &'b mut [N64],
+        members: Members,
+    ) -> Self {
+        let radius = members.radius();
+        let Members {
+            members,
+            weight_sum,
+        } = members;
         Self {
             events,
+            weights,
             members,
             weight_sum,
             radius,
@@ -75,20 +166,22 @@ impl<'a> Cell<'a> {
     /// This redistributes weights in such a way that all weights have
     /// the same sign.
     pub fn resample(&mut self) {
-        let orig_weight_sum = self.weight_sum();
-        if orig_weight_sum == n64(0.) {
-            for &idx in &self.members {
-                self.events[idx].1.weight = n64(0.);
+        // the sums only involve finite weights, so we can use plain
+        // f64 and check the result when writing it back
+        let orig_weight_sum = f64::from(self.weight_sum());
+        if orig_weight_sum == 0. {
+            for &(idx, _) in &self.members {
+                self.weights[idx] = n64(0.);
             }
         } else {
-            let mut abs_weight_sum = n64(0.);
-            for &idx in &self.members {
-                let awt = self.events[idx].1.weight.abs();
-                self.events[idx].1.weight = awt;
-                abs_weight_sum += awt;
+            let mut abs_weight_sum = 0.;
+            for &(idx, _) in &self.members {
+                abs_weight_sum += f64::from(self.weights[idx]).abs();
             }
-            for &idx in &self.members {
-                self.events[idx].1.weight *= orig_weight_sum / abs_weight_sum;
+            let factor = orig_weight_sum / abs_weight_sum;
+            for &(idx, _) in &self.members {
+                let awt = f64::from(self.weights[idx]).abs();
+                self.weights[idx] = n64(awt * factor);
             }
         }
     }
@@ -102,7 +195,7 @@ impl<'a> Cell<'a> {
     pub fn nneg_weights(&self) -> usize {
         self.members
             .iter()
-            .filter(|&&idx| self.events[idx].1.weight < 0.)
+            .filter(|&&(idx, _)| self.weights[idx] < 0.)
             .count()
     }
 
@@ -119,9 +212,554 @@ impl<'a> Cell<'a> {
     }
 
     /// Iterator over (distance, cell member)
+    ///
+    /// The weights of the returned events are the original ones.
     pub fn iter(
         &'a self,
-    ) -> Box<dyn std::iter::Iterator<Item = &'a (N64, Event)> + 'a> {
-        Box::new(self.members.iter().map(move |idx| &self.events[*idx]))
+    ) -> Box<dyn std::iter::Iterator<Item = (N64, EventView<'a>)> + 'a> {
+        Box::new(
+            self.members
+                .iter()
+                .map(move |(idx, dist)| (*dist, self.events.view(*idx))),
+        )
+    }
+}
+
+/// Number of events passed to [Distance::distance_many] at once
+const DISTANCE_BATCH_SIZE: usize = 1024;
+
+/// Buffers for [Members::naive] with one entry per event
+///
+/// These are reused for all seeds handled by the same thread.
+#[derive(Clone, Debug, Default)]
+struct NaiveBuffers {
+    dists: Vec<N64>,
+    order: Vec<(N64, usize)>,
+}
+
+thread_local! {
+    static NAIVE_BUFFERS: RefCell<NaiveBuffers> =
+        RefCell::new(NaiveBuffers::default());
+}
+
+/// Events selected for a new cell
+///
+/// In contrast to a [Cell], this only requires read access to the
+/// event weights. The selection can then be turned into a cell with
+/// [Cell::from_members], as long as the weights of the selected events
+/// have not changed in the meantime.
+#[derive(Clone, PartialEq, Eq, PartialOrd, Ord, Debug)]
+pub struct Members {
+    // (index, distance from the seed), starting with the seed
+    members: Vec<(usize, N64)>,
+    weight_sum: N64,
+}
+
+impl Members {
+    /// Select cell members by computing the distance to all events
+    ///
+    /// This works for any collection of [Events], for example an
+    /// [EventArena](crate::event_store::EventArena).
+    pub fn naive<E: Events + ?Sized, F: Distance + Sync + Send>(
+        events: &E,
+        weights: &[N64],
+        seed_idx: usize,
+        distance: &F,
+        max_size: N64,
+    ) -> Self {
+        let seed = events.view(seed_idx);
+        let seed_dist = distance.distance(seed, seed);
+        let NaiveBuffers {
+            mut dists,
+            mut order,
+        } = NAIVE_BUFFERS.with(|buffers| buffers.take());
+        order.clear();
+        if max_size < f64::MAX {
+            order.par_extend(
+                (0..events.len())
+                    .into_par_iter()
+                    .filter(|idx| *idx != seed_idx)
+                    .filter_map(|idx| {
+                        // events beyond the maximum cell size are never
+                        // added
+                        let e = events.view(idx);
+                        let dist =
+                            distance.distance_bounded(e, seed, max_size)?;
+                        Some((dist, idx))
+                    }),
+            );
+        } else {
+            // without a maximum cell size, distances are computed in
+            // batches
+            dists.clear();
+            dists.resize(events.len(), n64(0.));
+            dists
+                .par_chunks_mut(DISTANCE_BATCH_SIZE)
+                .enumerate()
+                .for_each_init(Vec::new, |batch, (b, dists)| {
+                    let start = b * DISTANCE_BATCH_SIZE;
+                    batch.clear();
+                    batch.extend(
+                        (start..start + dists.len())
+                            .map(|idx| events.view(idx)),
+                    );
+                    distance.distance_many(seed, batch, dists)
+                });
+            order.extend(
+                dists
+                    .iter()
+                    .enumerate()
+                    .filter(|(idx, _)| *idx != seed_idx)
+                    .map(|(idx, dist)| (*dist, idx)),
+            );
+        }
+        let mut nearest = SortedCandidates::new(order);
+        let members = Self::select(
+            weights,
+            (seed_idx, seed_dist),
+            &mut nearest,
+            max_size,
+        );
+        let order = nearest.into_inner();
+        NAIVE_BUFFERS
+            .with(|buffers| buffers.replace(NaiveBuffers { dists, order }));
+        members
+    }
+
+    /// Select cell members from precomputed distances
+    ///
+    /// `seed` is the index of the seed and its distance to itself.
+    /// `dists` has to contain (distance, index) pairs for all events
+    /// except for the seed, in any order. Events with a distance above
+    /// `max_size` can be left out.
+    pub fn from_distances(
+        weights: &[N64],
+        seed: (usize, N64),
+        dists: Vec<(N64, usize)>,
+        max_size: N64,
+    ) -> Self {
+        Self::select(weights, seed, SortedCandidates::new(dists), max_size)
+    }
+
+    /// Select cell members from candidates ordered by distance
+    ///
+    /// `seed` is the index of the seed and its distance to itself.
+    /// `nearest` has to yield (distance, index) pairs for all events
+    /// except for the seed in order of increasing distance. Events
+    /// with a distance above `max_size` can be left out.
+    pub fn from_nearest<I: Iterator<Item = (N64, usize)>>(
+        weights: &[N64],
+        seed: (usize, N64),
+        nearest: I,
+        max_size: N64,
+    ) -> Self {
+        Self::select(weights, seed, nearest, max_size)
+    }
+
+    /// Select cell members using a [VpTree]
+    ///
+    /// See [Cell::with_vp_tree].
+    pub fn with_vp_tree<E: Events + ?Sized, F: Distance + Sync + Send>(
+        events: &E,
+        weights: &[N64],
+        seed_idx: usize,
+        distance: &F,
+        max_size: N64,
+        tree: &VpTree,
+    ) -> Self {
+        let seed = events.view(seed_idx);
+        let seed_dist = distance.distance(seed, seed);
+        let mut nearest = tree.nearest(events, seed_idx, distance);
+        let members = Self::select(
+            weights,
+            (seed_idx, seed_dist),
+            &mut nearest,
+            max_size,
+        );
+        if nearest.aborted() {
+            debug!("Falling back to naive nearest-neighbour search");
+            return Self::naive(events, weights, seed_idx, distance, max_size);
+        }
+        members
+    }
+
+    /// Select cell members using a [PivotTable]
+    ///
+    /// See [Cell::with_pivot_table].
+    pub fn with_pivot_table<E: Events + ?Sized, F: Distance + Sync + Send>(
+        events: &E,
+        weights: &[N64],
+        seed_idx: usize,
+        distance: &F,
+        max_size: N64,
+        pivots: &PivotTable,
+    ) -> Self {
+        let seed = events.view(seed_idx);
+        let seed_dist = distance.distance(seed, seed);
+        let mut nearest = pivots.nearest(events, seed_idx, distance);
+        let members = Self::select(
+            weights,
+            (seed_idx, seed_dist),
+            &mut nearest,
+            max_size,
+        );
+        debug!(
+            "Computed {} of {} distances",
+            nearest.nevaluations(),
+            events.len()
+        );
+        members
+    }
+
+    /// Select cell members using [SignatureBuckets]
+    ///
+    /// See [Cell::with_signature_buckets].
+    pub fn with_signature_buckets<
+        E: Events + ?Sized,
+        F: Distance + Sync + Send,
+    >(
+        events: &E,
+        weights: &[N64],
+        seed_idx: usize,
+        distance: &F,
+        max_size: N64,
+        buckets: &SignatureBuckets,
+    ) -> Self {
+        let seed = events.view(seed_idx);
+        let seed_dist = distance.distance(seed, seed);
+        let mut nearest = buckets.nearest(events, seed_idx, distance);
+        let members = Self::select(
+            weights,
+            (seed_idx, seed_dist),
+            &mut nearest,
+            max_size,
+        );
+        debug!(
+            "Computed {} of {} distances",
+            nearest.nevaluations(),
+            events.len()
+        );
+        members
+    }
+
+    /// Select cell members using a [KnnGraph]
+    ///
+    /// See [Cell::with_knn_graph].
+    pub fn with_knn_graph<E: Events + ?Sized, F: Distance + Sync + Send>(
+        events: &E,
+        weights: &[N64],
+        seed_idx: usize,
+        distance: &F,
+        max_size: N64,
+        graph: &KnnGraph,
+    ) -> Self {
+        let seed = events.view(seed_idx);
+        let seed_dist = distance.distance(seed, seed);
+        let mut nearest = graph.nearest(events, seed_idx, distance);
+        let members = Self::select_with_bound(
+            weights,
+            (seed_idx, seed_dist),
+            &mut nearest,
+            max_size,
+            |nearest| nearest.next_bound(),
+        );
+        if nearest.fell_back() {
+            debug!("Computed distances to events outside the neighbour graph");
+        }
+        members
+    }
+
+    /// Select cell members using [CompactEvents]
+    ///
+    /// See [Cell::with_compact_events].
+    pub fn with_compact_events<
+        E: Events + ?Sized,
+        F: Distance + Sync + Send,
+    >(
+        events: &E,
+        weights: &[N64],
+        seed_idx: usize,
+        distance: &F,
+        max_size: N64,
+        compact: &CompactEvents,
+    ) -> Self {
+        let seed = events.view(seed_idx);
+        let seed_dist = distance.distance(seed, seed);
+        let mut nearest = compact.nearest(events, seed_idx, distance);
+        let members = Self::select(
+            weights,
+            (seed_idx, seed_dist),
+            &mut nearest,
+            max_size,
+        );
+        debug!(
+            "Computed {} of {} distances",
+            nearest.nevaluations(),
+            events.len()
+        );
+        members
+    }
+
+    /// Largest distance from the seed to any selected event
+    pub fn radius(&self) -> N64 {
+        self.members.iter().map(|(_, dist)| *dist).max().unwrap()
+    }
+
+    /// Indices of the selected events, starting with the seed
+    pub fn indices(&self) -> impl Iterator<Item = usize> + '_ {
+        self.members.iter().map(|(idx, _)| *idx)
+    }
+
+    /// Add the nearest neighbours of the seed until the weight sum is
+    /// non-negative
+    ///
+    /// `nearest` has to yield all events except for the seed as
+    /// (distance, index) pairs ordered by distance. For approximate
+    /// searches, the order may deviate slightly.
+    fn select<I: Iterator<Item = (N64, usize)>>(
+        weights: &[N64],
+        seed: (usize, N64),
+        nearest: I,
+        max_size: N64,
+    ) -> Self {
+        Self::select_with_bound(weights, seed, nearest, max_size, |_| None)
+    }
+
+    /// Like [select](Members::select), where `next_bound` gives a lower
+    /// bound on the distance of the next item of `nearest`, if that is
+    /// known without computing further distances
+    ///
+    /// This avoids advancing `nearest` just to check for ties.
+    fn select_with_bound<I, B>(
+        weights: &[N64],
+        seed: (usize, N64),
+        nearest: I,
+        max_size: N64,
+        next_bound: B,
+    ) -> Self
+    where
+        I: Iterator<Item = (N64, usize)>,
+        B: Fn(&I) -> Option<N64>,
+    {
+        let (seed_idx, _) = seed;
+        let mut candidates =
+            Candidates::new(nearest, next_bound, weights.len(), seed_idx);
+        let mut weight_sum = f64::from(weights[seed_idx]);
+        debug_assert!(weight_sum < 0.);
+        debug!("Cell seed with weight {:e}", weight_sum);
+        let mut members = vec![seed];
+        while weight_sum < 0. {
+            if let Some((dist, idx)) = candidates.next() {
+                trace!(
+                    "adding event with distance {}, weight {:e} to cell",
+                    dist,
+                    weights[idx]
+                );
+                if dist > max_size {
+                    break;
+                }
+                weight_sum += f64::from(weights[idx]);
+                members.push((idx, dist));
+            } else {
+                break;
+            };
+        }
+        Self {
+            members,
+            weight_sum: n64(weight_sum),
+        }
+    }
+}
+
+/// Cell candidates in order of increasing distance from the seed
+///
+/// `nearest` has to yield all events except for the seed as
+/// (distance, index) pairs ordered by distance. Among candidates with
+/// the same distance, we select the one that comes first in the
+/// candidate list of [CandidatePositions]. This ensures that the
+/// order does not depend on the nearest-neighbour search.
+struct Candidates<I, B> {
+    nearest: I,
+    // next item of `nearest`, if it was already taken to check for ties
+    peeked: Option<(N64, usize)>,
+    // lower bound on the distance of the next item of `nearest`
+    next_bound: B,
+    // candidates with distance `tie_dist` as (position, index)
+    ties: BTreeSet<(usize, usize)>,
+    tie_dist: N64,
+    positions: CandidatePositions,
+}
+
+impl<I, B> Candidates<I, B>
+where
+    I: Iterator<Item = (N64, usize)>,
+    B: Fn(&I) -> Option<N64>,
+{
+    fn new(nearest: I, next_bound: B, nevents: usize, seed_idx: usize) -> Self {
+        let mut positions = CandidatePositions::new(nevents);
+        positions.swap_remove(seed_idx);
+        Self {
+            nearest,
+            peeked: None,
+            next_bound,
+            ties: BTreeSet::new(),
+            tie_dist: n64(0.),
+            positions,
+        }
+    }
+
+    // the next item of `nearest` if its distance is `dist`
+    fn next_tie(&mut self, dist: N64) -> Option<(N64, usize)> {
+        if self.peeked.is_none() {
+            if matches!((self.next_bound)(&self.nearest), Some(b) if b > dist) {
+                return None;
+            }
+            self.peeked = self.nearest.next();
+        }
+        match self.peeked {
+            Some((d, _)) if d == dist => self.peeked.take(),
+            _ => None,
+        }
+    }
+}
+
+impl<I, B> Iterator for Candidates<I, B>
+where
+    I: Iterator<Item = (N64, usize)>,
+    B: Fn(&I) -> Option<N64>,
+{
+    type Item = (N64, usize);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.ties.is_empty() {
+            let (dist, idx) =
+                self.peeked.take().or_else(|| self.nearest.next())?;
+            let tie = match self.next_tie(dist) {
+                Some(tie) => tie,
+                None => {
+                    self.positions.swap_remove(idx);
+                    return Some((dist, idx));
+                }
+            };
+            self.tie_dist = dist;
+            for (_, idx) in [(dist, idx), tie] {
+                self.ties.insert((self.positions.position(idx), idx));
+            }
+            while let Some((_, idx)) = self.next_tie(dist) {
+                self.ties.insert((self.positions.position(idx), idx));
+            }
+        }
+        let first = *self.ties.iter().next().unwrap();
+        self.ties.remove(&first);
+        let (pos, idx) = first;
+        if let Some((moved, old_pos)) = self.positions.swap_remove(idx) {
+            if self.ties.remove(&(old_pos, moved)) {
+                self.ties.insert((pos, moved));
+            }
+        }
+        Some((self.tie_dist, idx))
+    }
+}
+
+const INITIAL_BATCH_SIZE: usize = 64;
+
+/// (distance, index) pairs in order of increasing distance
+///
+/// The pairs are sorted lazily in batches of doubling size, so that
+/// each additional item costs amortised O(log N) operations.
+pub(crate) struct SortedCandidates {
+    // order[..sorted] is sorted and no element is larger than any in
+    // order[sorted..]
+    order: Vec<(N64, usize)>,
+    sorted: usize,
+    next: usize,
+}
+
+impl SortedCandidates {
+    pub(crate) fn new(order: Vec<(N64, usize)>) -> Self {
+        Self {
+            order,
+            sorted: 0,
+            next: 0,
+        }
+    }
+
+    /// The underlying buffer, for reuse
+    fn into_inner(self) -> Vec<(N64, usize)> {
+        self.order
+    }
+
+    fn sort_next_batch(&mut self) {
+        let rest = &mut self.order[self.sorted..];
+        let batch_size = std::cmp::max(self.sorted, INITIAL_BATCH_SIZE);
+        if batch_size >= rest.len() {
+            rest.par_sort_unstable();
+            self.sorted = self.order.len();
+        } else {
+            rest.select_nth_unstable(batch_size - 1);
+            rest[..batch_size].par_sort_unstable();
+            self.sorted += batch_size;
+        }
+    }
+}
+
+impl Iterator for SortedCandidates {
+    type Item = (N64, usize);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.next == self.sorted {
+            self.sort_next_batch();
+        }
+        let next = self.order.get(self.next).copied();
+        self.next += 1;
+        next
+    }
+}
+
+/// Positions in a list of candidates from which selected cell
+/// members are removed with `swap_remove`
+///
+/// Only positions that differ from the original ones are stored.
+struct CandidatePositions {
+    len: usize,
+    position: HashMap<usize, usize>,
+    occupant: HashMap<usize, usize>,
+}
+
+impl CandidatePositions {
+    fn new(len: usize) -> Self {
+        Self {
+            len,
+            position: HashMap::new(),
+            occupant: HashMap::new(),
+        }
+    }
+
+    fn position(&self, idx: usize) -> usize {
+        *self.position.get(&idx).unwrap_or(&idx)
+    }
+
+    fn occupant(&self, pos: usize) -> usize {
+        *self.occupant.get(&pos).unwrap_or(&pos)
+    }
+
+    /// Remove the candidate with the given index
+    ///
+    /// If the last candidate is moved into the free position, returns
+    /// its index and previous position.
+    fn swap_remove(&mut self, idx: usize) -> Option<(usize, usize)> {
+        let pos = self.position(idx);
+        self.len -= 1;
+        let last = self.occupant(self.len);
+        self.position.remove(&idx);
+        self.occupant.remove(&self.len);
+        if pos == self.len {
+            self.occupant.remove(&pos);
+            None
+        } else {
+            self.occupant.insert(pos, last);
+            self.position.insert(last, pos);
+            Some((last, self.len))
+        }
     }
 }
@@ -0,0 +1,311 @@
+use crate::distance::{permutations, Distance, MAX_UNROLLED};
+use crate::event_store::Events;
+use crate::nearest::{EventCandidates, LazyNearest};
+
+use log::debug;
+use noisy_float::prelude::*;
+use rayon::prelude::*;
+
+/// Single-precision copy of the momenta of all events
+///
+/// Distances computed from this copy take about half the memory
+/// traffic of the original events. They are only used to rank
+/// candidates in a nearest-neighbour search: after subtracting a
+/// bound on the rounding error derived in `lower_bound`, they give a
+/// lower bound on the double-precision distance. Exact distances are
+/// then computed for all candidates whose bound lies below the
+/// distance of the next neighbour, so the result is the same as for
+/// the naive search.
+///
+/// This requires the [EuclWithScaledPt](crate::distance::EuclWithScaledPt)
+/// distance.
+#[derive(Clone, Debug)]
+pub struct CompactEvents {
+    // the particle types of event `i` are
+    // types[type_offsets[i]..type_offsets[i + 1]]
+    type_offsets: Vec<usize>,
+    types: Vec<TypeSet>,
+    // (px, py, pz, pt) of all particles
+    momenta: Vec<[f32; 4]>,
+    // sum of all particle norms and number of particles and particle
+    // types for each event, for the error bound in `lower_bound`
+    norms: Vec<f64>,
+    nops: Vec<f64>,
+    pt_weight: f32,
+}
+
+/// All particles of one type in an event
+#[derive(Copy, Clone, Debug)]
+struct TypeSet {
+    pid: i32,
+    start: usize,
+    len: usize,
+    // sum of the spatial momentum norms
+    spatial_norm: f32,
+    // sum of the transverse momenta
+    pt: f32,
+}
+
+/// Unit roundoff in single precision
+const U32: f64 = f32::EPSILON as f64 / 2.;
+
+/// Unit roundoff in double precision
+const U64: f64 = f64::EPSILON / 2.;
+
+/// Number of roundings in the distance between two particles
+const PAIR_OPS: f64 = 9.;
+
+/// Bound on the relative error after `k` roundings with unit roundoff `u`
+fn gamma(k: f64, u: f64) -> f64 {
+    debug_assert!(k * u < 1.);
+    k * u / (1. - k * u)
+}
+
+impl CompactEvents {
+    /// Make a single-precision copy of `events`
+    ///
+    /// Returns `None` if `distance` is not
+    /// [EuclWithScaledPt](crate::distance::EuclWithScaledPt).
+    pub fn new<E: Events + ?Sized, D: Distance + Sync>(
+        events: &E,
+        distance: &D,
+    ) -> Option<Self> {
+        let distance = distance.as_eucl_with_scaled_pt()?;
+        let nparticles = (0..events.len())
+            .flat_map(|idx| events.view(idx).outgoing())
+            .map(|(_, p)| p.len())
+            .sum();
+        debug!("Storing {} momenta in single precision", nparticles);
+        let mut type_offsets = Vec::with_capacity(events.len() + 1);
+        type_offsets.push(0);
+        let mut types = Vec::new();
+        let mut momenta = Vec::with_capacity(nparticles);
+        for idx in 0..events.len() {
+            let event = events.view(idx);
+            for set in event.type_sets() {
+                let (p, pts) = (event.momenta(set), event.pts(set));
+                let summary = set.summary();
+                types.push(TypeSet {
+                    pid: set.pid(),
+                    start: momenta.len(),
+                    len: p.len(),
+                    spatial_norm: f64::from(summary.spatial_norm) as f32,
+                    pt: f64::from(summary.pt) as f32,
+                });
+                momenta.extend(p.iter().zip(pts).map(|(p, pt)| {
+                    [p[1], p[2], p[3], *pt].map(|c| f64::from(c) as f32)
+                }));
+            }
+            type_offsets.push(types.len());
+        }
+        let norms = (0..events.len())
+            .into_par_iter()
+            .map(|idx| {
+                let e = events.view(idx);
+                let norms = distance.type_norms(e).unwrap_or_default();
+                norms.into_iter().map(|(_, n)| f64::from(n)).sum()
+            })
+            .collect();
+        let nops = (0..events.len())
+            .into_par_iter()
+            .map(|idx| {
+                let e = events.view(idx);
+                let nparticles: usize =
+                    e.outgoing().map(|(_, p)| p.len()).sum();
+                (nparticles + e.outgoing().len()) as f64
+            })
+            .collect();
+        Some(Self {
+            type_offsets,
+            types,
+            momenta,
+            norms,
+            nops,
+            pt_weight: f64::from(distance.pt_weight()) as f32,
+        })
+    }
+
+    /// Number of events
+    pub fn len(&self) -> usize {
+        self.type_offsets.len() - 1
+    }
+
+    /// Whether there are no events
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// All events except for the seed in order of increasing distance
+    pub fn nearest<'a, E: Events + ?Sized, D: Distance + Sync>(
+        &'a self,
+        events: &'a E,
+        seed_idx: usize,
+        distance: &'a D,
+    ) -> Nearest<'a, D, E> {
+        debug_assert_eq!(events.len(), self.len());
+        let bounds = (0..self.len())
+            .into_par_iter()
+            .filter(|&idx| idx != seed_idx)
+            .map(|idx| (self.lower_bound(seed_idx, idx), idx))
+            .collect();
+        let candidates =
+            EventCandidates::new(events, seed_idx, distance, bounds);
+        LazyNearest::new(candidates, n64(1.))
+    }
+
+    fn types(&self, idx: usize) -> &[TypeSet] {
+        &self.types[self.type_offsets[idx]..self.type_offsets[idx + 1]]
+    }
+
+    fn momenta(&self, set: &TypeSet) -> &[[f32; 4]] {
+        &self.momenta[set.start..set.start + set.len]
+    }
+
+    /// Lower bound on the distance between two events
+    ///
+    /// This is the distance in single precision minus a bound on the
+    /// rounding error, following the usual analysis with relative
+    /// errors |θ_k| ≤ γ_k = k u / (1 - k u) after k roundings with
+    /// unit roundoff u.
+    ///
+    /// For two particles a, b with weighted norms |a|, |b|, each
+    /// component of a - b is rounded at most four times (conversion of
+    /// both momenta and the transverse momentum weight, subtraction,
+    /// multiplication by the weight), so the difference vector is off
+    /// by at most γ_4 (|a| + |b|). Squaring, summing and the square root
+    /// add a relative error γ_5, in total at most γ_9 (|a| + |b|).
+    /// The same holds for the difference of two
+    /// [summaries](crate::event::Event::summaries), which replaces the
+    /// pairing for sets with more than [MAX_UNROLLED] particles and is
+    /// a lower bound on the paired distance. Summing over pairs and
+    /// particle types adds fewer roundings than there are particles
+    /// and types in both events. The minimum over pairings changes by
+    /// at most the largest error of any pairing. With the sum N of all
+    /// particle norms in both events, the error is therefore at most
+    /// γ_k N, where k is 9 plus the number of particles and types.
+    ///
+    /// The double-precision distance has the same error bound with
+    /// the double-precision unit roundoff, which we add. Underflow can
+    /// only add an absolute error of order the square root of the
+    /// smallest normal number for each particle, which we also add.
+    fn lower_bound(&self, idx1: usize, idx2: usize) -> N64 {
+        let dist = self.approx_distance(idx1, idx2);
+        if !dist.is_finite() {
+            return n64(0.);
+        }
+        let nops = self.nops[idx1] + self.nops[idx2];
+        let k = PAIR_OPS + nops;
+        let norm = self.norms[idx1] + self.norms[idx2];
+        // two extra roundings in double precision for computing `bound`
+        let rel_err = gamma(k, U32) + gamma(k + 2., U64);
+        let abs_err = 2. * nops * f64::from(f32::MIN_POSITIVE).sqrt();
+        let bound = f64::from(dist) - (rel_err * norm + abs_err);
+        if bound > 0. {
+            n64(bound)
+        } else {
+            n64(0.)
+        }
+    }
+
+    fn approx_distance(&self, idx1: usize, idx2: usize) -> f32 {
+        let (types1, types2) = (self.types(idx1), self.types(idx2));
+        let mut dist = 0.;
+        let mut i1 = 0;
+        let mut i2 = 0;
+        while i1 < types1.len() || i2 < types2.len() {
+            let t1 = types1.get(i1).map(|t| t.pid);
+            let t2 = types2.get(i2).map(|t| t.pid);
+            match (t1, t2) {
+                (Some(t1), Some(t2)) if t1 == t2 => {
+                    dist += self.set_distance(&types1[i1], &types2[i2]);
+                    i1 += 1;
+                    i2 += 1;
+                }
+                (Some(t1), Some(t2)) if t1 < t2 => {
+                    dist += self.set_norm(&types2[i2]);
+                    i2 += 1;
+                }
+                (None, _) => {
+                    dist += self.set_norm(&types2[i2]);
+                    i2 += 1;
+                }
+                _ => {
+                    dist += self.set_norm(&types1[i1]);
+                    i1 += 1;
+                }
+            }
+        }
+        dist
+    }
+
+    fn set_norm(&self, set: &TypeSet) -> f32 {
+        let zero = [0.; 4];
+        self.momenta(set)
+            .iter()
+            .map(|p| pt_dist(p, &zero, self.pt_weight))
+            .sum()
+    }
+
+    fn set_distance(&self, s1: &TypeSet, s2: &TypeSet) -> f32 {
+        let (p1, p2) = (self.momenta(s1), self.momenta(s2));
+        let (p1, p2) = if p1.len() > p2.len() {
+            (p2, p1)
+        } else {
+            (p1, p2)
+        };
+        match p2.len() {
+            1 => min_paired_distance::<1>(p1, p2, self.pt_weight),
+            2 => min_paired_distance::<2>(p1, p2, self.pt_weight),
+            3 => min_paired_distance::<3>(p1, p2, self.pt_weight),
+            4 => min_paired_distance::<4>(p1, p2, self.pt_weight),
+            _ => {
+                debug_assert!(p2.len() > MAX_UNROLLED);
+                let dn = s1.spatial_norm - s2.spatial_norm;
+                let dpt = self.pt_weight * (s1.pt - s2.pt);
+                (dn * dn + dpt * dpt).sqrt()
+            }
+        }
+    }
+}
+
+fn min_paired_distance<const N: usize>(
+    p1: &[[f32; 4]],
+    p2: &[[f32; 4]],
+    pt_weight: f32,
+) -> f32 {
+    debug_assert!(p1.len() <= N && p2.len() == N);
+    let (perms, nperms) = const { permutations::<N>() };
+    // pad p1 with zeros
+    let mut cost = [[0.; N]; N];
+    for (i, row) in cost.iter_mut().enumerate() {
+        let p = p1.get(i).copied().unwrap_or_default();
+        for (cost, q) in row.iter_mut().zip(p2) {
+            *cost = pt_dist(&p, q, pt_weight);
+        }
+    }
+    let mut min_dist = f32::INFINITY;
+    for perm in &perms[..nperms] {
+        let mut dist = 0.;
+        for (j, &i) in perm.iter().enumerate() {
+            dist += cost[i][j];
+        }
+        if dist < min_dist {
+            min_dist = dist;
+        }
+    }
+    min_dist
+}
+
+fn pt_dist(p: &[f32; 4], q: &[f32; 4], pt_weight: f32) -> f32 {
+    let dx = p[0] - q[0];
+    let dy = p[1] - q[1];
+    let dz = p[2] - q[2];
+    let dpt = pt_weight * (p[3] - q[3]);
+    (dx * dx + dy * dy + dz * dz + dpt * dpt).sqrt()
+}
+
+/// Search for nearest neighbours using [CompactEvents]
+///
+/// Exact distances are only computed when the single-precision lower
+/// bound is not sufficient.
+pub type Nearest<'a, D, E> = LazyNearest<EventCandidates<'a, D, E>>;
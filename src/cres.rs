@@ -51,10 +51,10 @@ use std::convert::From;
 use std::iter::Iterator;
 
 use log::info;
-use rayon::prelude::*;
 use thiserror::Error;
 
-use crate::event::{Event, EventBuilder};
+use crate::event::{weights_by_id, Event, EventBuilder};
+use crate::event_store::{EventStoreBuilder, Precision};
 use crate::traits::*;
 
 /// Build a new [Cres] object
@@ -81,6 +81,8 @@ impl<R, C, S, U, W> CresBuilder<R, C, S, U, W> {
             resampler: self.resampler,
             unweighter: self.unweighter,
             writer: self.writer,
+            memory_limit: None,
+            precision: Precision::default(),
         }
     }
 }
@@ -105,6 +107,8 @@ pub struct Cres<R, C, S, U, W> {
     resampler: S,
     unweighter: U,
     writer: W,
+    memory_limit: Option<usize>,
+    precision: Precision,
 }
 
 impl<R, C, S, U, W> From<CresBuilder<R, C, S, U, W>> for Cres<R, C, S, U, W> {
@@ -113,6 +117,29 @@ impl<R, C, S, U, W> From<CresBuilder<R, C, S, U, W>> for Cres<R, C, S, U, W> {
     }
 }
 
+impl<R, C, S, U, W> Cres<R, C, S, U, W> {
+    /// Limit the memory used for storing events
+    ///
+    /// Events exceeding the limit are moved to a temporary file on
+    /// disk, see [EventStoreBuilder]. The default is `None`, meaning
+    /// no limit.
+    pub fn memory_limit(self, memory_limit: Option<usize>) -> Self {
+        Self {
+            memory_limit,
+            ..self
+        }
+    }
+
+    /// Set the precision for storing particle momenta
+    ///
+    /// With a lower precision, events take less memory, at the cost
+    /// of less accurate distances, see [Precision]. The default is
+    /// [Precision::Double].
+    pub fn precision(self, precision: Precision) -> Self {
+        Self { precision, ..self }
+    }
+}
+
 #[derive(Debug, Error)]
 pub enum CresError<E1, E2, E3, E4, E5, E6> {
     #[error("Failed to read event: {0}")]
@@ -127,6 +154,8 @@ pub enum CresError<E1, E2, E3, E4, E5, E6> {
     UnweightErr(E5),
     #[error("Failed to write events: {0}")]
     WriteErr(E6),
+    #[error("Failed to store events: {0}")]
+    StorageErr(std::io::Error),
 }
 
 impl<R, C, S, U, W, E, Ev> Cres<R, C, S, U, W>
@@ -164,27 +193,30 @@ where
         self.reader.rewind().map_err(RewindErr)?;
 
         let converter = &mut self.converter;
-        let events: Result<Vec<_>, _> = (&mut self.reader)
-            .enumerate()
-            .map(|(id, ev)| match ev {
-                Ok(ev) => {
-                    let builder = EventBuilder::new(id);
-                    converter.try_convert((ev, builder)).map_err(ConversionErr)
-                }
-                Err(err) => Err(ReadErr(err)),
-            })
-            .collect();
-        let events = events?;
+        let mut events =
+            EventStoreBuilder::new(self.memory_limit).precision(self.precision);
+        for (id, ev) in (&mut self.reader).enumerate() {
+            let ev = ev.map_err(ReadErr)?;
+            let builder = EventBuilder::new(id);
+            let ev = converter
+                .try_convert((ev, builder))
+                .map_err(ConversionErr)?;
+            events.push(ev).map_err(StorageErr)?;
+        }
+        let events = events.build().map_err(StorageErr)?;
         info!("Read {} events", events.len());
 
-        let events = self.resampler.resample(events).map_err(ResamplingErr)?;
+        let events = self
+            .resampler
+            .resample_store(events)
+            .map_err(ResamplingErr)?;
 
-        let mut events =
-            self.unweighter.unweight(events).map_err(UnweightErr)?;
-        events.par_sort_unstable();
+        let events = self.unweighter.unweight(events).map_err(UnweightErr)?;
+        let weights = weights_by_id(&events);
+        drop(events);
 
         self.reader.rewind().map_err(RewindErr)?;
         let reader = &mut self.reader;
-        self.writer.write(reader, &events).map_err(WriteErr)
+        self.writer.write(reader, &weights).map_err(WriteErr)
     }
 }
@@ -1,49 +1,328 @@
-use crate::event::Event;
+use crate::event::{EventView, KinematicSummary, TypeSet};
 use crate::four_vector::FourVector;
+use crate::simd::{components, pt_dist_sq, pt_dist_sq_many, Momenta};
 
+use std::cell::RefCell;
 use std::cmp::Ordering;
 
 use noisy_float::prelude::*;
-use permutohedron::LexicalPermutation;
 
 /// A metric (distance function) in the space of all events
 pub trait Distance {
-    fn distance(&self, ev1: &Event, ev2: &Event) -> N64;
+    fn distance(&self, ev1: EventView<'_>, ev2: EventView<'_>) -> N64;
+
+    /// Distance if it does not exceed `bound`
+    ///
+    /// Returns `None` if the distance is larger than `bound`.
+    /// Implementations can use this to stop the computation early. If
+    /// the result is `Some`, it has to be the same as for
+    /// [distance](Distance::distance).
+    ///
+    /// The default is to compute the full distance.
+    fn distance_bounded(
+        &self,
+        ev1: EventView<'_>,
+        ev2: EventView<'_>,
+        bound: N64,
+    ) -> Option<N64> {
+        let dist = self.distance(ev1, ev2);
+        if dist > bound {
+            None
+        } else {
+            Some(dist)
+        }
+    }
+
+    /// Distances between `seed` and each of the `events`
+    ///
+    /// The distance to `events[i]` is written to `out[i]`, where `out`
+    /// has the same length as `events`. Implementations can override
+    /// this to share setup costs between distance computations or to
+    /// vectorise over events. The result has to be the same as for
+    /// [distance](Distance::distance).
+    ///
+    /// The default is to call [distance](Distance::distance) for each
+    /// event.
+    fn distance_many(
+        &self,
+        seed: EventView<'_>,
+        events: &[EventView<'_>],
+        out: &mut [N64],
+    ) {
+        debug_assert_eq!(events.len(), out.len());
+        for (out, event) in out.iter_mut().zip(events) {
+            *out = self.distance(*event, seed);
+        }
+    }
+
+    /// Norms of the particle sets of each type, for lower distance bounds
+    ///
+    /// If this returns a list of (particle id, norm) pairs for every
+    /// event, it has to hold that d(e1, e2) ≥ Σ_t |n1(t) - n2(t)|.
+    /// Here the sum runs over all particle types t in either event,
+    /// ni(t) is the norm for type t in event ei, and the norm for
+    /// types missing from an event is zero.
+    ///
+    /// The default is to return `None`, meaning no bounds are known.
+    fn type_norms(&self, _ev: EventView<'_>) -> Option<Vec<(i32, N64)>> {
+        None
+    }
+
+    /// Access this distance as [EuclWithScaledPt], if it is one
+    ///
+    /// This enables a single-precision prefilter in nearest-neighbour
+    /// searches, see [CompactEvents](crate::compact_events::CompactEvents).
+    /// The default is to return `None`.
+    fn as_eucl_with_scaled_pt(&self) -> Option<&EuclWithScaledPt> {
+        None
+    }
 }
 
+/// Smallest set size that is paired greedily by default
 const FALLBACK_SIZE: usize = 8;
 
+/// Relative tolerance for lower distance bounds to allow for rounding
+pub(crate) const BOUND_TOLERANCE: f64 = 1e-12;
+
+/// Lower a distance bound computed from quantities of size `scale`
+///
+/// To allow for rounding errors, the bound is lowered by
+/// [BOUND_TOLERANCE] times `scale`. The result is clamped to be
+/// non-negative. A NaN bound can only come from infinite inputs and
+/// is also mapped to zero.
+pub(crate) fn tolerant_lower_bound(bound: f64, scale: f64) -> N64 {
+    if bound == f64::INFINITY {
+        return N64::infinity();
+    }
+    let bound = bound - BOUND_TOLERANCE * scale;
+    if bound > 0. {
+        n64(bound)
+    } else {
+        n64(0.)
+    }
+}
+
+/// Lower bound on d(x, y) from the triangle inequality, given d(x, z) and d(y, z)
+pub(crate) fn triangle_lower_bound(dist_xz: N64, dist_yz: N64) -> N64 {
+    let (d1, d2) = (f64::from(dist_xz), f64::from(dist_yz));
+    tolerant_lower_bound((d1 - d2).abs(), d1 + d2)
+}
+
 /// The distance function defined in [arXiv:2109.07851](https://arxiv.org/abs/2109.07851)
 #[derive(Copy, Clone, Eq, PartialEq, Ord, PartialOrd, Hash, Debug, Default)]
 pub struct EuclWithScaledPt {
     pt_weight: N64,
+    exact_pairing: bool,
 }
 
 impl Distance for EuclWithScaledPt {
-    fn distance(&self, ev1: &Event, ev2: &Event) -> N64 {
-        let mut dist = n64(0.);
-        let out1 = ev1.outgoing();
-        let out2 = ev2.outgoing();
+    fn distance(&self, ev1: EventView<'_>, ev2: EventView<'_>) -> N64 {
+        self.distance_bounded(ev1, ev2, N64::infinity()).unwrap()
+    }
+
+    /// Distance if it does not exceed `bound`
+    ///
+    /// For a finite `bound`, events are first rejected if their
+    /// [lower bound](EuclWithScaledPt::lower_bound) exceeds it.
+    /// Otherwise, the computation stops as soon as the sum over
+    /// particle types or the sum over the particle pairs in the
+    /// current pairing exceeds the bound.
+    ///
+    /// Internally, all arithmetic is done with plain `f64`. Only the
+    /// final result is checked for NaN.
+    fn distance_bounded(
+        &self,
+        ev1: EventView<'_>,
+        ev2: EventView<'_>,
+        bound: N64,
+    ) -> Option<N64> {
+        let bound = f64::from(bound);
+        if bound < f64::INFINITY && self.lower_bound(ev1, ev2) > bound {
+            return None;
+        }
+        let dist =
+            self.sum_over_types(ev1, ev2, bound, |idx1, idx2, limit| {
+                let s1 = &ev1.type_sets()[idx1];
+                let s2 = &ev2.type_sets()[idx2];
+                let (p1, p2) =
+                    (Particles::new(ev1, s1), Particles::new(ev2, s2));
+                self.set_distance(p1, p2, limit)
+            })?;
+        Some(n64(dist))
+    }
+
+    /// Distances between `seed` and a block of `events`
+    ///
+    /// The momenta of all particles in `events` that have the same
+    /// type as a small particle set in the seed are collected in
+    /// structure-of-arrays layout. Each seed particle is then compared
+    /// against all of them at once with a vectorised kernel. Pairings
+    /// of larger sets are computed one event at a time. The results
+    /// are the same as for [distance](Distance::distance).
+    fn distance_many(
+        &self,
+        seed: EventView<'_>,
+        events: &[EventView<'_>],
+        out: &mut [N64],
+    ) {
+        debug_assert_eq!(events.len(), out.len());
+        BLOCK_SCRATCH.with(|scratch| {
+            let scratch = &mut *scratch.borrow_mut();
+            scratch.fill(seed, events, self.pt_weight.into());
+            for (e, (out, event)) in out.iter_mut().zip(events).enumerate() {
+                let dist = self.sum_over_types(
+                    *event,
+                    seed,
+                    f64::INFINITY,
+                    |idx1, idx2, limit| {
+                        let s1 = &event.type_sets()[idx1];
+                        let s2 = &seed.type_sets()[idx2];
+                        if std::cmp::max(s1.len(), s2.len()) <= MAX_UNROLLED {
+                            let set = (e, idx2, s1.len(), s2.len());
+                            scratch.set_distance(set, limit)
+                        } else {
+                            self.set_distance(
+                                Particles::new(*event, s1),
+                                Particles::new(seed, s2),
+                                limit,
+                            )
+                        }
+                    },
+                );
+                *out = n64(dist.unwrap());
+            }
+        })
+    }
+
+    /// The sum of the norms of all particles of each type
+    ///
+    /// Any pairing of two particle sets (padded with zero momenta) has
+    /// a distance of at least the difference of these norms by the
+    /// triangle inequality.
+    fn type_norms(&self, ev: EventView<'_>) -> Option<Vec<(i32, N64)>> {
+        let norms = ev
+            .type_sets()
+            .iter()
+            .map(|set| (set.pid(), n64(self.pt_norm(Particles::new(ev, set)))))
+            .collect();
+        Some(norms)
+    }
+
+    fn as_eucl_with_scaled_pt(&self) -> Option<&EuclWithScaledPt> {
+        Some(self)
+    }
+}
+
+impl EuclWithScaledPt {
+    /// Distance function with the given parameter τ = `pt_weight`
+    ///
+    /// See [arXiv:2109.07851](https://arxiv.org/abs/2109.07851) for a
+    /// definition of τ
+    pub fn new(pt_weight: N64) -> Self {
+        EuclWithScaledPt {
+            pt_weight,
+            exact_pairing: false,
+        }
+    }
+
+    /// Whether to find the optimal pairing for large particle sets
+    ///
+    /// By default, sets with at least eight particles are paired
+    /// greedily, which is faster but can overestimate the distance.
+    /// With exact pairing, the assignment problem is solved for all
+    /// set sizes.
+    pub fn with_exact_pairing(self, exact_pairing: bool) -> Self {
+        Self {
+            exact_pairing,
+            ..self
+        }
+    }
+
+    /// The parameter τ
+    pub fn pt_weight(&self) -> N64 {
+        self.pt_weight
+    }
+
+    /// Lower bound on the distance between two events
+    ///
+    /// This only uses the [summaries](EventView::summaries) of the events
+    /// and is much cheaper than the distance itself. For each particle
+    /// type, let S be the difference between the summed spatial
+    /// momentum norms in the two events and T the difference between
+    /// the summed transverse momenta. By the triangle inequality, the
+    /// distance between the particle sets of that type is at least
+    /// √(S² + τ²T²) for any pairing.
+    pub fn lower_bound(&self, ev1: EventView<'_>, ev2: EventView<'_>) -> N64 {
+        let zero = KinematicSummary::default();
+        let (out1, out2) = (ev1.type_sets(), ev2.type_sets());
+        let tau = f64::from(self.pt_weight);
+        let mut bound = 0.;
+        let mut scale = 0.;
+        let mut add = |s1: &KinematicSummary, s2: &KinematicSummary| {
+            let (n1, n2) =
+                (f64::from(s1.spatial_norm), f64::from(s2.spatial_norm));
+            let (pt1, pt2) = (tau * f64::from(s1.pt), tau * f64::from(s2.pt));
+            bound += ((n1 - n2).powi(2) + (pt1 - pt2).powi(2)).sqrt();
+            scale += n1 + n2 + pt1 + pt2;
+        };
+        if ev1.signature() == ev2.signature() {
+            for (s1, s2) in out1.iter().zip(out2) {
+                add(s1.summary(), s2.summary());
+            }
+        } else {
+            merge_type_sets(out1, out2, &zero, add);
+        }
+        tolerant_lower_bound(bound, scale)
+    }
+
+    /// Sum over the distances between the particle sets of each type
+    ///
+    /// `set_distance(idx1, idx2, limit)` has to compute the distance
+    /// between the sets `ev1.type_sets()[idx1]` and
+    /// `ev2.type_sets()[idx2]` of the same type. Sets without a
+    /// counterpart contribute their norm. Returns `None` if the sum
+    /// exceeds `bound`.
+    fn sum_over_types(
+        &self,
+        ev1: EventView<'_>,
+        ev2: EventView<'_>,
+        bound: f64,
+        mut set_distance: impl FnMut(usize, usize, (f64, f64)) -> Option<f64>,
+    ) -> Option<f64> {
+        let mut dist = 0.;
+        let out1 = ev1.type_sets();
+        let out2 = ev2.type_sets();
+        if ev1.signature() == ev2.signature() {
+            // same particle types and multiplicities, no merge needed
+            for idx in 0..out1.len() {
+                dist += set_distance(idx, idx, (dist, bound))?;
+                if dist > bound {
+                    return None;
+                }
+            }
+            return Some(dist);
+        }
         let mut idx1 = 0;
         let mut idx2 = 0;
         while idx1 < out1.len() && idx2 < out2.len() {
-            let (t1, p1) = &out1[idx1];
-            let (t2, p2) = &out2[idx2];
-            match t1.cmp(t2) {
+            match out1[idx1].pid().cmp(&out2[idx2].pid()) {
                 Ordering::Greater => {
-                    dist += self.pt_norm(p1);
+                    dist += self.pt_norm(Particles::new(ev1, &out1[idx1]));
                     idx1 += 1;
                 }
                 Ordering::Less => {
-                    dist += self.pt_norm(p2);
+                    dist += self.pt_norm(Particles::new(ev2, &out2[idx2]));
                     idx2 += 1;
                 }
                 Ordering::Equal => {
-                    dist += self.set_distance(p1, p2);
+                    dist += set_distance(idx1, idx2, (dist, bound))?;
                     idx1 += 1;
                     idx2 += 1;
                 }
             }
+            if dist > bound {
+                return None;
+            }
         }
 
         // consume remainders
@@ -51,99 +330,710 @@ impl Distance for EuclWithScaledPt {
         if idx1 < out1.len() {
             dist += out1[idx1..]
                 .iter()
-                .map(|(_t, p)| self.pt_norm(p))
-                .sum::<N64>();
+                .map(|set| self.pt_norm(Particles::new(ev1, set)))
+                .sum::<f64>();
         } else if idx2 < out2.len() {
             dist += out2[idx2..]
                 .iter()
-                .map(|(_t, p)| self.pt_norm(p))
-                .sum::<N64>();
+                .map(|set| self.pt_norm(Particles::new(ev2, set)))
+                .sum::<f64>();
+        }
+        if dist > bound {
+            None
+        } else {
+            Some(dist)
         }
-        dist
     }
-}
 
-impl EuclWithScaledPt {
-    /// Distance function with the given parameter τ = `pt_weight`
-    ///
-    /// See [arXiv:2109.07851](https://arxiv.org/abs/2109.07851) for a
-    /// definition of τ
-    pub fn new(pt_weight: N64) -> Self {
-        EuclWithScaledPt { pt_weight }
+    fn pt_norm(&self, p: Particles<'_>) -> f64 {
+        let pt_weight = f64::from(self.pt_weight);
+        p.iter()
+            .map(|p| pt_dist_sq(p, [0.; 4], pt_weight).sqrt())
+            .sum()
+    }
+
+    // In the following, `limit` = (offset, bound) means that we are
+    // only interested in results d with offset + d <= bound. Larger
+    // results may be replaced by `None`.
+
+    fn set_distance(
+        &self,
+        p1: Particles<'_>,
+        p2: Particles<'_>,
+        limit: (f64, f64),
+    ) -> Option<f64> {
+        if p1.len() > p2.len() {
+            return self.set_distance(p2, p1, limit);
+        }
+        match p2.len() {
+            1 => self.min_paired_distance_unrolled::<1>(p1, p2, limit),
+            2 => self.min_paired_distance_unrolled::<2>(p1, p2, limit),
+            3 => self.min_paired_distance_unrolled::<3>(p1, p2, limit),
+            4 => self.min_paired_distance_unrolled::<4>(p1, p2, limit),
+            n if n < FALLBACK_SIZE || self.exact_pairing => {
+                self.min_paired_distance(p1, p2, limit)
+            }
+            _ => self.norm_ordered_paired_distance(p1, p2, limit),
+        }
     }
 
-    fn pt_norm(&self, p: &[FourVector]) -> N64 {
-        p.iter().map(|p| pt_norm(p, self.pt_weight)).sum()
+    /// Minimum over all pairings of `p1` and `p2`, where `p2` has
+    /// exactly `N` elements
+    ///
+    /// All pairings are enumerated from a table that is generated at
+    /// compile time. For small `N`, the compiler unrolls all loops and
+    /// keeps the distances in registers.
+    fn min_paired_distance_unrolled<const N: usize>(
+        &self,
+        p1: Particles<'_>,
+        p2: Particles<'_>,
+        (offset, bound): (f64, f64),
+    ) -> Option<f64> {
+        debug_assert!(p1.len() <= N && p2.len() == N);
+        let pt_weight = f64::from(self.pt_weight);
+        // the transverse momenta are only computed once per particle
+        let q: [[f64; 4]; N] = std::array::from_fn(|j| p2.components(j));
+        // pad p1 with zeros
+        let mut cost = [[0.; N]; N];
+        for (i, row) in cost.iter_mut().enumerate() {
+            let p = p1.components(i);
+            for (cost, q) in row.iter_mut().zip(q) {
+                *cost = pt_dist_sq(p, q, pt_weight).sqrt();
+            }
+        }
+        Self::min_over_pairings(&cost, (offset, bound))
     }
 
-    fn set_distance(&self, p1: &[FourVector], p2: &[FourVector]) -> N64 {
-        if std::cmp::max(p1.len(), p2.len()) < FALLBACK_SIZE {
-            self.min_paired_distance(p1, p2)
+    /// Minimum over all pairings for the given `N`×`N` cost matrix
+    ///
+    /// All pairings are enumerated from a table that is generated at
+    /// compile time.
+    fn min_over_pairings<const N: usize>(
+        cost: &[[f64; N]; N],
+        (offset, bound): (f64, f64),
+    ) -> Option<f64> {
+        let (perms, nperms) = const { permutations::<N>() };
+        let mut min_dist = f64::INFINITY;
+        for perm in &perms[..nperms] {
+            let mut dist = 0.;
+            for (j, &i) in perm.iter().enumerate() {
+                dist += cost[i][j];
+            }
+            if dist < min_dist {
+                min_dist = dist;
+            }
+        }
+        if offset + min_dist > bound {
+            None
         } else {
-            self.norm_ordered_paired_distance(p1, p2)
+            Some(min_dist)
         }
     }
 
-    fn min_paired_distance(&self, p1: &[FourVector], p2: &[FourVector]) -> N64 {
-        if p1.len() > p2.len() {
-            return self.min_paired_distance(p2, p1);
-        }
+    /// Minimum over all pairings of `p1` and `p2`
+    ///
+    /// This solves the assignment problem for the distances between
+    /// the particles with [min_cost_assignment].
+    fn min_paired_distance(
+        &self,
+        p1: Particles<'_>,
+        p2: Particles<'_>,
+        (offset, bound): (f64, f64),
+    ) -> Option<f64> {
         debug_assert!(p1.len() <= p2.len());
-        // copy and pad with zeros
-        let zero = FourVector::new();
-        let mut p1: Vec<_> = p1.iter().copied().collect();
-        p1.resize_with(p2.len(), || zero);
-        p1.sort_unstable();
-        let mut min_dist = self.paired_distance(&p1, p2);
-        while p1.next_permutation() {
-            min_dist = std::cmp::min(min_dist, self.paired_distance(&p1, p2));
-        }
-        min_dist
-    }
-
-    fn paired_distance(&self, p1: &[FourVector], p2: &[FourVector]) -> N64 {
-        debug_assert!(p1.len() == p2.len());
-        p1.iter()
-            .zip(p2.iter())
-            .map(|(p1, p2)| pt_dist(p1, p2, self.pt_weight))
-            .sum()
+        let n = p2.len();
+        SCRATCH.with(|scratch| {
+            let Scratch {
+                q,
+                cost,
+                assignment,
+                ..
+            } = &mut *scratch.borrow_mut();
+            for q in q.iter_mut() {
+                q.clear();
+            }
+            for p in p2.iter() {
+                for (q, c) in q.iter_mut().zip(p) {
+                    q.push(c);
+                }
+            }
+            let [px, py, pz, pt] = &*q;
+            let q = Momenta { px, py, pz, pt };
+            // pad p1 with zeros
+            cost.clear();
+            cost.resize(n * n, 0.);
+            let mut max_cost = 0.;
+            for (i, row) in cost.chunks_exact_mut(n).enumerate() {
+                let p = p1.components(i);
+                pt_dist_sq_many(p, q, self.pt_weight.into(), row);
+                let mut row_max = 0.;
+                for cost in row {
+                    *cost = cost.sqrt();
+                    row_max = f64::max(row_max, *cost);
+                }
+                max_cost += row_max;
+            }
+            // allow for rounding errors in the lower bounds from the
+            // assignment solver
+            let tolerance = BOUND_TOLERANCE * n as f64 * max_cost;
+            let max_cost = bound - offset + tolerance;
+            if !min_cost_assignment(cost, n, max_cost, assignment) {
+                return None;
+            }
+            let mut dist = 0.;
+            for (j, &i) in assignment.row[1..=n].iter().enumerate() {
+                dist += cost[(i - 1) * n + j];
+            }
+            if offset + dist > bound {
+                None
+            } else {
+                Some(dist)
+            }
+        })
     }
 
+    /// Greedy approximation to the minimum over all pairings
+    ///
+    /// This is the smaller result of
+    /// [ordered_paired_distance](Self::ordered_paired_distance) in both
+    /// directions. It is never below the minimum.
     fn norm_ordered_paired_distance(
         &self,
-        p1: &[FourVector],
-        p2: &[FourVector],
-    ) -> N64 {
-        if p1.len() > p2.len() {
-            return self.norm_ordered_paired_distance(p2, p1);
+        p1: Particles<'_>,
+        p2: Particles<'_>,
+        limit: (f64, f64),
+    ) -> Option<f64> {
+        debug_assert!(p1.len() <= p2.len());
+        SCRATCH.with(|scratch| {
+            let scratch = &mut scratch.borrow_mut();
+            let n = p2.len();
+            let dist = self.ordered_paired_distance(p1, p2, n, limit, scratch);
+            let (offset, bound) = limit;
+            // the second pairing is only relevant if it is shorter
+            let limit = match dist {
+                Some(dist) => (0., dist),
+                None => limit,
+            };
+            match self.ordered_paired_distance(p2, p1, n, limit, scratch) {
+                Some(dist2) if offset + dist2 <= bound => {
+                    Some(f64::min(dist.unwrap_or(dist2), dist2))
+                }
+                _ => dist,
+            }
+        })
+    }
+
+    // Each particle in `p1` is paired with the nearest remaining one
+    // in `p2`. Both are padded with zero momenta to length `n`.
+    fn ordered_paired_distance(
+        &self,
+        p1: Particles<'_>,
+        p2: Particles<'_>,
+        n: usize,
+        (offset, bound): (f64, f64),
+        Scratch { q, dists, .. }: &mut Scratch,
+    ) -> Option<f64> {
+        debug_assert!(p1.len() <= n && p2.len() <= n);
+        for q in q.iter_mut() {
+            q.clear();
+        }
+        for i in 0..n {
+            for (q, c) in q.iter_mut().zip(p2.components(i)) {
+                q.push(c);
+            }
+        }
+        dists.clear();
+        dists.resize(n, 0.);
+        let mut dist = 0.;
+        for i in 0..n {
+            let [px, py, pz, pt] = &*q;
+            let q_rem = Momenta { px, py, pz, pt };
+            let p = p1.components(i);
+            pt_dist_sq_many(p, q_rem, self.pt_weight.into(), dists);
+            let mut n = 0;
+            for (i, d) in dists.iter().enumerate() {
+                if *d < dists[n] {
+                    n = i;
+                }
+            }
+            dist += dists[n].sqrt();
+            if offset + dist > bound {
+                return None;
+            }
+            for q in q.iter_mut() {
+                q.swap_remove(n);
+            }
+            dists.pop();
+        }
+        Some(dist)
+    }
+}
+
+/// Particles of one type in an event, with their transverse momenta
+#[derive(Copy, Clone, Debug)]
+struct Particles<'a> {
+    momenta: &'a [FourVector],
+    pts: &'a [N64],
+}
+
+impl<'a> Particles<'a> {
+    fn new(event: EventView<'a>, set: &TypeSet) -> Self {
+        Self {
+            momenta: event.momenta(set),
+            pts: event.pts(set),
+        }
+    }
+
+    fn len(&self) -> usize {
+        self.momenta.len()
+    }
+
+    /// Components (px, py, pz, pt) of particle `i`
+    ///
+    /// Beyond the last particle, this is a zero momentum.
+    fn components(&self, i: usize) -> [f64; 4] {
+        match self.momenta.get(i) {
+            Some(p) => components(p, self.pts[i]),
+            None => [0.; 4],
+        }
+    }
+
+    /// Components (px, py, pz, pt) of all particles
+    fn iter(&self) -> impl Iterator<Item = [f64; 4]> + 'a {
+        let pts = self.pts;
+        self.momenta
+            .iter()
+            .zip(pts)
+            .map(|(p, pt)| components(p, *pt))
+    }
+}
+
+/// Reusable buffers for pairing large particle sets
+#[derive(Clone, Debug, Default)]
+struct Scratch {
+    // particles in the larger set in structure-of-arrays layout
+    q: [Vec<f64>; 4],
+    // distances between all particles in row-major order
+    cost: Vec<f64>,
+    assignment: Assignment,
+    // squared distances to the remaining particles in a greedy pairing
+    dists: Vec<f64>,
+}
+
+thread_local! {
+    static SCRATCH: RefCell<Scratch> = RefCell::new(Scratch::default());
+}
+
+/// Reusable buffers for [EuclWithScaledPt::distance_many]
+///
+/// Only particle sets with at most [MAX_UNROLLED] elements are
+/// included, both in the seed and in the events.
+#[derive(Clone, Debug, Default)]
+struct BlockScratch {
+    // number of particle types in the seed
+    ntypes: usize,
+    // components of the seed particles of type k are
+    // seed[seed_offsets[k]..seed_offsets[k + 1]]
+    seed: Vec<[f64; 4]>,
+    seed_offsets: Vec<usize>,
+    // distance of each seed particle to a zero momentum
+    seed_norms: Vec<f64>,
+    // event particles with the same type as a seed set in
+    // structure-of-arrays layout, grouped by type. Particles of type k
+    // are in the range type_offsets[k]..type_offsets[k + 1].
+    q: [Vec<f64>; 4],
+    type_offsets: Vec<usize>,
+    // start in `q` of the particles of type k in event e, at index
+    // e * ntypes + k
+    set_offsets: Vec<usize>,
+    // distances between the particles of type k and each seed
+    // particle of that type, followed by a zero momentum. There is
+    // one row for each of them, starting at dist_offsets[k].
+    dists: Vec<f64>,
+    dist_offsets: Vec<usize>,
+}
+
+impl BlockScratch {
+    fn fill(
+        &mut self,
+        seed: EventView<'_>,
+        events: &[EventView<'_>],
+        pt_weight: f64,
+    ) {
+        let seed_sets = seed.type_sets();
+        self.ntypes = seed_sets.len();
+        self.seed.clear();
+        self.seed_offsets.clear();
+        self.seed_offsets.push(0);
+        for q in self.q.iter_mut() {
+            q.clear();
+        }
+        self.type_offsets.clear();
+        self.type_offsets.push(0);
+        self.set_offsets.clear();
+        self.set_offsets.resize(events.len() * self.ntypes, 0);
+        for (k, set) in seed_sets.iter().enumerate() {
+            let particles = Particles::new(seed, set);
+            if particles.len() <= MAX_UNROLLED {
+                self.seed.extend(particles.iter());
+                self.add_particles_of_type(k, set.pid(), events);
+            }
+            self.seed_offsets.push(self.seed.len());
+            self.type_offsets.push(self.q[0].len());
+        }
+        self.seed_norms.clear();
+        self.seed_norms.extend(
+            self.seed
+                .iter()
+                .map(|&p| pt_dist_sq([0.; 4], p, pt_weight).sqrt()),
+        );
+        self.dists.clear();
+        self.dist_offsets.clear();
+        for k in 0..self.ntypes {
+            self.dist_offsets.push(self.dists.len());
+            let types = self.type_offsets[k]..self.type_offsets[k + 1];
+            let [px, py, pz, pt] = &self.q;
+            let q = Momenta {
+                px: &px[types.clone()],
+                py: &py[types.clone()],
+                pz: &pz[types.clone()],
+                pt: &pt[types.clone()],
+            };
+            let seed =
+                &self.seed[self.seed_offsets[k]..self.seed_offsets[k + 1]];
+            for &p in seed.iter().chain(std::iter::once(&[0.; 4])) {
+                let start = self.dists.len();
+                self.dists.resize(start + types.len(), 0.);
+                pt_dist_sq_many(p, q, pt_weight, &mut self.dists[start..]);
+            }
+        }
+        for dist in &mut self.dists {
+            *dist = dist.sqrt();
+        }
+    }
+
+    fn add_particles_of_type(
+        &mut self,
+        k: usize,
+        pid: i32,
+        events: &[EventView<'_>],
+    ) {
+        for (e, event) in events.iter().enumerate() {
+            let set = event.type_sets().iter().find(|set| set.pid() == pid);
+            let Some(set) = set else { continue };
+            let particles = Particles::new(*event, set);
+            if particles.len() > MAX_UNROLLED {
+                continue;
+            }
+            self.set_offsets[e * self.ntypes + k] = self.q[0].len();
+            for p in particles.iter() {
+                for (q, c) in self.q.iter_mut().zip(p) {
+                    q.push(c);
+                }
+            }
+        }
+    }
+
+    /// Distance between the particles of type `k` in event `e` and
+    /// in the seed
+    ///
+    /// `set` is (event index, seed type index, length of the event set,
+    /// length of the seed set), where neither set has more than
+    /// [MAX_UNROLLED] elements. The result is the same as for
+    /// [EuclWithScaledPt::set_distance].
+    fn set_distance(
+        &self,
+        set: (usize, usize, usize, usize),
+        limit: (f64, f64),
+    ) -> Option<f64> {
+        let (_, _, event_len, seed_len) = set;
+        match std::cmp::max(event_len, seed_len) {
+            1 => self.min_paired_distance_unrolled::<1>(set, limit),
+            2 => self.min_paired_distance_unrolled::<2>(set, limit),
+            3 => self.min_paired_distance_unrolled::<3>(set, limit),
+            4 => self.min_paired_distance_unrolled::<4>(set, limit),
+            _ => unreachable!(),
         }
-        let mut p1: Vec<_> = p1.iter().copied().collect();
-        p1.resize_with(p2.len(), FourVector::new);
-        std::cmp::min(
-            self.ordered_paired_distance_eq_size(&p1, p2),
-            self.ordered_paired_distance_eq_size(p2, &p1),
-        )
     }
 
-    fn ordered_paired_distance_eq_size(
+    /// Like [EuclWithScaledPt::min_paired_distance_unrolled], with
+    /// the larger set having exactly `N` elements
+    ///
+    /// The cost matrix is the same as for
+    /// `set_distance(event set, seed set)`. Distances between an event
+    /// particle and a seed particle are symmetric, so they can be taken
+    /// from the precomputed block in either role.
+    fn min_paired_distance_unrolled<const N: usize>(
         &self,
-        p1: &[FourVector],
-        p2: &[FourVector],
-    ) -> N64 {
-        debug_assert!(p1.len() == p2.len());
-        let mut dists: Vec<_> = p2.iter().map(|q| (n64(0.), q)).collect();
-        let mut dist = n64(0.);
-        for p in p1 {
-            for (dist, q) in &mut dists {
-                *dist = pt_dist_sq(p, *q, self.pt_weight);
+        (e, k, event_len, seed_len): (usize, usize, usize, usize),
+        limit: (f64, f64),
+    ) -> Option<f64> {
+        let mut cost = [[0.; N]; N];
+        if event_len > seed_len {
+            // pad the seed with zeros, which have row index `seed_len`
+            for (i, row) in cost.iter_mut().enumerate() {
+                let i = std::cmp::min(i, seed_len);
+                for (j, cost) in row.iter_mut().enumerate() {
+                    *cost = self.dist(e, k, i, j);
+                }
+            }
+        } else {
+            // pad the event with zeros
+            for (i, row) in cost.iter_mut().enumerate() {
+                for (j, cost) in row.iter_mut().enumerate() {
+                    *cost = if i < event_len {
+                        self.dist(e, k, j, i)
+                    } else {
+                        self.seed_norm(k, j)
+                    };
+                }
+            }
+        }
+        EuclWithScaledPt::min_over_pairings(&cost, limit)
+    }
+
+    /// Distance between seed particle `i` and particle `j` of event
+    /// `e`, both of type `k`
+    ///
+    /// For `i` equal to the number of seed particles of type `k`, this
+    /// is the distance between the event particle and a zero momentum.
+    fn dist(&self, e: usize, k: usize, i: usize, j: usize) -> f64 {
+        let type_len = self.type_offsets[k + 1] - self.type_offsets[k];
+        let start =
+            self.set_offsets[e * self.ntypes + k] - self.type_offsets[k];
+        self.dists[self.dist_offsets[k] + i * type_len + start + j]
+    }
+
+    /// Distance between seed particle `j` of type `k` and a zero
+    /// momentum
+    fn seed_norm(&self, k: usize, j: usize) -> f64 {
+        self.seed_norms[self.seed_offsets[k] + j]
+    }
+}
+
+thread_local! {
+    static BLOCK_SCRATCH: RefCell<BlockScratch> =
+        RefCell::new(BlockScratch::default());
+}
+
+/// Largest set size for [EuclWithScaledPt::min_paired_distance_unrolled]
+pub(crate) const MAX_UNROLLED: usize = 4;
+/// Number of permutations of [MAX_UNROLLED] elements
+const MAX_PERMUTATIONS: usize = 24;
+
+/// All permutations of 0..N for N ≤ [MAX_UNROLLED]
+///
+/// Returns a table with space for [MAX_PERMUTATIONS] permutations and
+/// the number of permutations N!. The permutations are in
+/// lexicographic order.
+pub(crate) const fn permutations<const N: usize>(
+) -> ([[usize; N]; MAX_PERMUTATIONS], usize) {
+    assert!(N <= MAX_UNROLLED);
+    let mut perms = [[0; N]; MAX_PERMUTATIONS];
+    let mut perm = [0; N];
+    let mut i = 0;
+    while i < N {
+        perm[i] = i;
+        i += 1;
+    }
+    let mut nperms = 0;
+    loop {
+        perms[nperms] = perm;
+        nperms += 1;
+        // next permutation in lexicographic order
+        let mut i = N;
+        while i > 1 && perm[i - 2] >= perm[i - 1] {
+            i -= 1;
+        }
+        if i <= 1 {
+            return (perms, nperms);
+        }
+        let pivot = i - 2;
+        let mut j = N - 1;
+        while perm[j] <= perm[pivot] {
+            j -= 1;
+        }
+        let tmp = perm[pivot];
+        perm[pivot] = perm[j];
+        perm[j] = tmp;
+        // reverse the suffix
+        let (mut lo, mut hi) = (pivot + 1, N - 1);
+        while lo < hi {
+            let tmp = perm[lo];
+            perm[lo] = perm[hi];
+            perm[hi] = tmp;
+            lo += 1;
+            hi -= 1;
+        }
+    }
+}
+
+/// Call `f` with the summaries of each particle type in either list
+///
+/// Types that only appear in one of the lists are paired with `zero`.
+fn merge_type_sets<'a>(
+    out1: &'a [TypeSet],
+    out2: &'a [TypeSet],
+    zero: &'a KinematicSummary,
+    mut f: impl FnMut(&'a KinematicSummary, &'a KinematicSummary),
+) {
+    let mut idx1 = 0;
+    let mut idx2 = 0;
+    while idx1 < out1.len() || idx2 < out2.len() {
+        let t1 = out1.get(idx1).map(|set| set.pid());
+        let t2 = out2.get(idx2).map(|set| set.pid());
+        match (t1, t2) {
+            (Some(t1), Some(t2)) if t1 == t2 => {
+                f(out1[idx1].summary(), out2[idx2].summary());
+                idx1 += 1;
+                idx2 += 1;
+            }
+            (Some(t1), Some(t2)) if t1 < t2 => {
+                f(zero, out2[idx2].summary());
+                idx2 += 1;
+            }
+            (None, _) => {
+                f(zero, out2[idx2].summary());
+                idx2 += 1;
             }
-            let (n, min) =
-                dists.iter().enumerate().min_by_key(|(_n, d)| *d).unwrap();
-            dist += min.0.sqrt();
-            dists.swap_remove(n);
+            _ => {
+                f(out1[idx1].summary(), zero);
+                idx1 += 1;
+            }
+        }
+    }
+}
+
+/// Buffers for [min_cost_assignment]
+///
+/// All entries use one-based indices, index 0 is an auxiliary
+/// unassigned row or column.
+#[derive(Clone, Debug, Default)]
+struct Assignment {
+    // row assigned to each column
+    row: Vec<usize>,
+    // row and column potentials
+    u: Vec<f64>,
+    v: Vec<f64>,
+    // previous column on the augmenting path
+    way: Vec<usize>,
+    min_v: Vec<f64>,
+    used: Vec<bool>,
+    // whether each row has been assigned a column
+    assigned: Vec<bool>,
+}
+
+/// Solve the assignment problem for the n x n matrix `cost`
+///
+/// `cost` is in row-major order. Afterwards, `assignment.row[j]` is
+/// the (one-based) row assigned to the (one-based) column `j`, such
+/// that the sum of the costs is minimal. This is the Hungarian
+/// algorithm in the O(n³) formulation with row and column potentials,
+/// see e.g. R. Jonker, A. Volgenant, Computing 38 (1987) 325.
+///
+/// The sum of all potentials is a lower bound on the final result. If
+/// it exceeds `max_cost`, the search is stopped and `false` is
+/// returned.
+fn min_cost_assignment(
+    cost: &[f64],
+    n: usize,
+    max_cost: f64,
+    assignment: &mut Assignment,
+) -> bool {
+    debug_assert_eq!(cost.len(), n * n);
+    let Assignment {
+        row,
+        u,
+        v,
+        way,
+        min_v,
+        used,
+        assigned,
+    } = assignment;
+    for buf in [&mut *u, &mut *v] {
+        buf.clear();
+        buf.resize(n + 1, 0.);
+    }
+    for buf in [&mut *row, &mut *way] {
+        buf.clear();
+        buf.resize(n + 1, 0);
+    }
+    // Column reduction: start with the cheapest row for each column,
+    // unless that row is already taken
+    assigned.clear();
+    assigned.resize(n + 1, false);
+    for j in (1..=n).rev() {
+        let mut min_row = 1;
+        for i in 2..=n {
+            if cost[(i - 1) * n + j - 1] < cost[(min_row - 1) * n + j - 1] {
+                min_row = i;
+            }
+        }
+        v[j] = cost[(min_row - 1) * n + j - 1];
+        if !assigned[min_row] {
+            assigned[min_row] = true;
+            row[j] = min_row;
+        }
+    }
+    // the sum of all potentials is a lower bound on the minimum cost
+    if v.iter().sum::<f64>() > max_cost {
+        return false;
+    }
+    for i in 1..=n {
+        if assigned[i] {
+            continue;
+        }
+        row[0] = i;
+        let mut col = 0;
+        min_v.clear();
+        min_v.resize(n + 1, f64::INFINITY);
+        used.clear();
+        used.resize(n + 1, false);
+        loop {
+            used[col] = true;
+            let i0 = row[col];
+            let cost = &cost[(i0 - 1) * n..i0 * n];
+            let mut delta = f64::INFINITY;
+            let mut next_col = 0;
+            for j in 1..=n {
+                if used[j] {
+                    continue;
+                }
+                let cur = cost[j - 1] - u[i0] - v[j];
+                if cur < min_v[j] {
+                    min_v[j] = cur;
+                    way[j] = col;
+                }
+                if min_v[j] < delta {
+                    delta = min_v[j];
+                    next_col = j;
+                }
+            }
+            for j in 0..=n {
+                if used[j] {
+                    u[row[j]] += delta;
+                    v[j] -= delta;
+                } else {
+                    min_v[j] -= delta;
+                }
+            }
+            col = next_col;
+            if row[col] == 0 {
+                break;
+            }
+        }
+        // augment along the path
+        while col != 0 {
+            let prev = way[col];
+            row[col] = row[prev];
+            col = prev;
+        }
+        v[0] = 0.;
+        if u.iter().sum::<f64>() + v.iter().sum::<f64>() > max_cost {
+            return false;
         }
-        dist
     }
+    true
 }
 
 pub fn pt_norm(p: &FourVector, pt_weight: N64) -> N64 {
@@ -154,12 +1044,3 @@ pub fn pt_norm_sq(p: &FourVector, pt_weight: N64) -> N64 {
     let pt = pt_weight * p.pt();
     p.spatial_norm_sq() + pt * pt
 }
-
-fn pt_dist(p: &FourVector, q: &FourVector, pt_weight: N64) -> N64 {
-    pt_dist_sq(p, q, pt_weight).sqrt()
-}
-
-fn pt_dist_sq(p: &FourVector, q: &FourVector, pt_weight: N64) -> N64 {
-    let dpt = pt_weight * (p.pt() - q.pt());
-    (*p - *q).spatial_norm_sq() + dpt * dpt
-}
@@ -0,0 +1,185 @@
+use crate::distance::{Distance, EuclWithScaledPt};
+use crate::event::EventView;
+
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+
+use log::{debug, info};
+use lru::LruCache;
+use noisy_float::prelude::*;
+
+/// Number of independently locked parts of a [DistanceCache]
+const NUM_SHARDS: usize = 64;
+
+/// Estimated memory used by a single cached distance, including the
+/// bookkeeping of the least-recently-used cache
+const ENTRY_SIZE: usize = 80;
+
+/// Concurrent cache of distances between events
+///
+/// Distances are stored by the ordered pair of event ids. Swapping the
+/// events can change the distance by rounding, so a cached distance is
+/// only reused for the same order of arguments. When the cache
+/// is full, the least recently used distances are dropped. To reduce
+/// lock contention between threads, the cache is split into shards
+/// with separate locks.
+#[derive(Debug)]
+pub struct DistanceCache {
+    shards: Vec<Mutex<LruCache<(usize, usize), N64>>>,
+    hits: AtomicUsize,
+    misses: AtomicUsize,
+}
+
+impl DistanceCache {
+    /// New cache using roughly at most `memory_limit` bytes
+    pub fn new(memory_limit: usize) -> Self {
+        let capacity = std::cmp::max(memory_limit / ENTRY_SIZE / NUM_SHARDS, 1);
+        debug!("Caching up to {} distances", capacity * NUM_SHARDS);
+        let shards = (0..NUM_SHARDS)
+            .map(|_| Mutex::new(LruCache::new(capacity)))
+            .collect();
+        Self {
+            shards,
+            hits: AtomicUsize::new(0),
+            misses: AtomicUsize::new(0),
+        }
+    }
+
+    /// Look up the distance from the event with id `id1` to the one
+    /// with id `id2`
+    pub fn get(&self, id1: usize, id2: usize) -> Option<N64> {
+        let key = (id1, id2);
+        let dist = self.shard(key).lock().unwrap().get(&key).copied();
+        let counter = if dist.is_some() {
+            &self.hits
+        } else {
+            &self.misses
+        };
+        counter.fetch_add(1, Ordering::Relaxed);
+        dist
+    }
+
+    /// Store the distance from the event with id `id1` to the one with
+    /// id `id2`
+    pub fn insert(&self, id1: usize, id2: usize, dist: N64) {
+        let key = (id1, id2);
+        self.shard(key).lock().unwrap().put(key, dist);
+    }
+
+    /// Number of successful lookups
+    pub fn hits(&self) -> usize {
+        self.hits.load(Ordering::Relaxed)
+    }
+
+    /// Number of failed lookups
+    pub fn misses(&self) -> usize {
+        self.misses.load(Ordering::Relaxed)
+    }
+
+    /// Log the fraction of successful lookups
+    pub fn report(&self) {
+        let (hits, misses) = (self.hits(), self.misses());
+        let lookups = hits + misses;
+        if lookups == 0 {
+            return;
+        }
+        info!(
+            "Distance cache hit rate: {:.1}% of {} lookups",
+            100. * hits as f64 / lookups as f64,
+            lookups
+        );
+    }
+
+    fn shard(
+        &self,
+        (id1, id2): (usize, usize),
+    ) -> &Mutex<LruCache<(usize, usize), N64>> {
+        // Fibonacci hashing to spread neighbouring ids over the shards
+        let hash = (id1 as u64 ^ (id2 as u64).rotate_left(32))
+            .wrapping_mul(0x9E37_79B9_7F4A_7C15);
+        &self.shards[(hash >> 58) as usize % NUM_SHARDS]
+    }
+}
+
+/// A distance with an optional [DistanceCache]
+///
+/// Without a cache, all calls are forwarded to the underlying
+/// distance.
+#[derive(Debug)]
+pub struct CachedDistance<'a, D> {
+    distance: &'a D,
+    cache: Option<DistanceCache>,
+}
+
+impl<'a, D> CachedDistance<'a, D> {
+    /// Cache distances using roughly at most `memory_limit` bytes
+    ///
+    /// If `memory_limit` is `None`, no distances are cached.
+    pub fn new(distance: &'a D, memory_limit: Option<usize>) -> Self {
+        Self {
+            distance,
+            cache: memory_limit.map(DistanceCache::new),
+        }
+    }
+
+    /// Access the cache
+    pub fn cache(&self) -> Option<&DistanceCache> {
+        self.cache.as_ref()
+    }
+}
+
+impl<'a, D: Distance> Distance for CachedDistance<'a, D> {
+    fn distance(&self, ev1: EventView<'_>, ev2: EventView<'_>) -> N64 {
+        let cache = match &self.cache {
+            Some(cache) => cache,
+            None => return self.distance.distance(ev1, ev2),
+        };
+        if let Some(dist) = cache.get(ev1.id(), ev2.id()) {
+            return dist;
+        }
+        let dist = self.distance.distance(ev1, ev2);
+        cache.insert(ev1.id(), ev2.id(), dist);
+        dist
+    }
+
+    fn distance_bounded(
+        &self,
+        ev1: EventView<'_>,
+        ev2: EventView<'_>,
+        bound: N64,
+    ) -> Option<N64> {
+        let cache = match &self.cache {
+            Some(cache) => cache,
+            None => return self.distance.distance_bounded(ev1, ev2, bound),
+        };
+        if let Some(dist) = cache.get(ev1.id(), ev2.id()) {
+            return if dist > bound { None } else { Some(dist) };
+        }
+        // only complete distances are cached
+        let dist = self.distance.distance_bounded(ev1, ev2, bound)?;
+        cache.insert(ev1.id(), ev2.id(), dist);
+        Some(dist)
+    }
+
+    fn distance_many(
+        &self,
+        seed: EventView<'_>,
+        events: &[EventView<'_>],
+        out: &mut [N64],
+    ) {
+        if self.cache.is_none() {
+            return self.distance.distance_many(seed, events, out);
+        }
+        for (out, event) in out.iter_mut().zip(events) {
+            *out = self.distance(*event, seed);
+        }
+    }
+
+    fn type_norms(&self, ev: EventView<'_>) -> Option<Vec<(i32, N64)>> {
+        self.distance.type_norms(ev)
+    }
+
+    fn as_eucl_with_scaled_pt(&self) -> Option<&EuclWithScaledPt> {
+        self.distance.as_eucl_with_scaled_pt()
+    }
+}
@@ -1,8 +1,11 @@
 use crate::four_vector::FourVector;
 
+use std::collections::HashMap;
 use std::convert::From;
 use std::default::Default;
+use std::sync::{Arc, RwLock};
 
+use lazy_static::lazy_static;
 use noisy_float::prelude::*;
 
 pub type MomentumSet = Vec<FourVector>;
@@ -52,11 +55,38 @@ impl EventBuilder {
 
     /// Construct an event
     pub fn build(self) -> Event {
-        let outgoing_by_pid = compress_outgoing(self.outgoing_by_pid);
+        let mut out = self.outgoing_by_pid;
+        out.sort_unstable_by(|a, b| b.cmp(a));
+        let mut types: Vec<TypeSet> = Vec::new();
+        let mut momenta = Vec::with_capacity(out.len());
+        for (pid, p) in out {
+            match types.last_mut() {
+                Some(set) if set.pid == pid => set.len += 1,
+                _ => types.push(TypeSet {
+                    pid,
+                    start: momenta.len(),
+                    len: 1,
+                    summary: KinematicSummary::default(),
+                }),
+            }
+            momenta.push(p);
+        }
+        let pts = transverse_momenta(&momenta);
+        for set in &mut types {
+            set.summary = KinematicSummary::new(
+                set.particles(&momenta),
+                set.particles(&pts),
+            );
+        }
+        let signature: Vec<_> =
+            types.iter().map(|set| (set.pid, set.len as u32)).collect();
         Event {
             id: self.id,
             weight: self.weight,
-            outgoing_by_pid,
+            signature: SignatureId::intern(&signature),
+            types,
+            momenta,
+            pts,
         }
     }
 }
@@ -67,30 +97,150 @@ impl From<EventBuilder> for Event {
     }
 }
 
-fn compress_outgoing(
-    mut out: Vec<(i32, FourVector)>,
-) -> Vec<(i32, Vec<FourVector>)> {
-    out.sort_unstable_by(|a, b| b.cmp(a));
-    let mut outgoing_by_pid: Vec<(i32, Vec<_>)> = Vec::new();
-    for (id, p) in out {
-        match outgoing_by_pid.last_mut() {
-            Some((pid, v)) if *pid == id => v.push(p),
-            _ => outgoing_by_pid.push((id, vec![p])),
-        }
-    }
-    outgoing_by_pid
-}
-
 /// A Monte Carlo scattering event
+///
+/// The momenta of all outgoing particles are kept in a single buffer,
+/// with their transverse momenta in a second one, so each event only
+/// owns three heap allocations. To avoid even these,
+/// many events can be stored together in an
+/// [EventArena](crate::event_store::EventArena).
 #[derive(PartialEq, Eq, PartialOrd, Ord, Debug, Clone, Default)]
 pub struct Event {
     id: usize,
     pub weight: N64,
 
-    outgoing_by_pid: Vec<(i32, MomentumSet)>,
+    signature: SignatureId,
+    types: Vec<TypeSet>,
+    // momenta of all outgoing particles, grouped by type
+    momenta: Vec<FourVector>,
+    // transverse momenta in the same order
+    pts: Vec<N64>,
+}
+
+/// Identifier of an interned event signature
+///
+/// The signature of an event lists the particle ids of all outgoing
+/// particles together with the number of particles for each id, in
+/// the same order as [Event::outgoing]. Each distinct signature is
+/// stored once in a global table, and events with the same signature
+/// have the same identifier.
+#[derive(PartialEq, Eq, PartialOrd, Ord, Hash, Debug, Clone, Copy, Default)]
+pub struct SignatureId(u32);
+
+#[derive(Debug)]
+struct SignatureTable {
+    signatures: Vec<Arc<[(i32, u32)]>>,
+    index: HashMap<Arc<[(i32, u32)]>, u32>,
 }
 
-const EMPTY_SLICE: &[FourVector] = &[];
+lazy_static! {
+    static ref SIGNATURES: RwLock<SignatureTable> = {
+        // the default identifier is the signature without particles
+        let empty: Arc<[(i32, u32)]> = Arc::new([]);
+        RwLock::new(SignatureTable {
+            signatures: vec![empty.clone()],
+            index: HashMap::from([(empty, 0)]),
+        })
+    };
+}
+
+impl SignatureId {
+    fn intern(signature: &[(i32, u32)]) -> Self {
+        if let Some(&idx) = SIGNATURES.read().unwrap().index.get(signature) {
+            return Self(idx);
+        }
+        let mut table = SIGNATURES.write().unwrap();
+        if let Some(&idx) = table.index.get(signature) {
+            return Self(idx);
+        }
+        let idx = table.signatures.len() as u32;
+        let signature: Arc<[_]> = signature.into();
+        table.signatures.push(signature.clone());
+        table.index.insert(signature, idx);
+        Self(idx)
+    }
+
+    /// The (particle id, number of particles) pairs of the signature
+    pub fn signature(self) -> Arc<[(i32, u32)]> {
+        SIGNATURES.read().unwrap().signatures[self.0 as usize].clone()
+    }
+
+    /// All signatures interned so far, indexed by their identifier
+    pub(crate) fn all() -> Vec<Arc<[(i32, u32)]>> {
+        SIGNATURES.read().unwrap().signatures.clone()
+    }
+
+    pub(crate) fn from_index(idx: u32) -> Self {
+        Self(idx)
+    }
+
+    pub(crate) fn index(self) -> u32 {
+        self.0
+    }
+}
+
+/// All outgoing particles of one type in an event
+#[derive(PartialEq, Eq, PartialOrd, Ord, Debug, Clone, Copy, Default)]
+pub struct TypeSet {
+    pid: i32,
+    // position of the momenta in the momentum buffer of the event, and
+    // likewise for the transverse momenta
+    start: usize,
+    len: usize,
+    summary: KinematicSummary,
+}
+
+impl TypeSet {
+    /// Particle id
+    pub fn pid(&self) -> i32 {
+        self.pid
+    }
+
+    /// Number of particles
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// Whether there are no particles
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// Kinematic summary of the particles
+    pub fn summary(&self) -> &KinematicSummary {
+        &self.summary
+    }
+
+    // the entries for these particles in a per-particle buffer
+    fn particles<'a, T>(&self, buffer: &'a [T]) -> &'a [T] {
+        &buffer[self.start..self.start + self.len]
+    }
+}
+
+/// Summed kinematic quantities of all particles of one type
+///
+/// These allow cheap lower bounds on the distance between events.
+#[derive(PartialEq, Eq, PartialOrd, Ord, Debug, Clone, Copy, Default)]
+pub struct KinematicSummary {
+    /// Sum of the spatial momentum norms
+    pub spatial_norm: N64,
+    /// Sum of the transverse momenta
+    pub pt: N64,
+}
+
+impl KinematicSummary {
+    fn new(p: &[FourVector], pts: &[N64]) -> Self {
+        Self {
+            spatial_norm: p.iter().map(|p| p.spatial_norm()).sum(),
+            pt: pts.iter().copied().sum(),
+        }
+    }
+}
+
+/// The transverse momenta of all `momenta`
+pub(crate) fn transverse_momenta(momenta: &[FourVector]) -> Vec<N64> {
+    momenta.iter().map(FourVector::pt).collect()
+}
 
 impl Event {
     pub fn new() -> Self {
@@ -102,25 +252,256 @@ impl Event {
         self.id
     }
 
+    /// The interned signature of the event
+    pub fn signature(&self) -> SignatureId {
+        self.signature
+    }
+
+    /// Event with the given id and weight, but without particles
+    pub(crate) fn header(id: usize, weight: N64) -> Self {
+        Self {
+            id,
+            weight,
+            ..Default::default()
+        }
+    }
+
+    /// Construct an event from momenta that are already grouped by type
+    ///
+    /// `content` has to be the (particle id, number of particles) list
+    /// of `signature`, and `momenta` has to be in the same order. Unlike
+    /// [EventBuilder::build], this neither sorts the momenta nor looks
+    /// up the signature in the global table.
+    pub(crate) fn from_signature(
+        id: usize,
+        weight: N64,
+        signature: SignatureId,
+        content: &[(i32, u32)],
+        momenta: Vec<FourVector>,
+    ) -> Self {
+        let pts = transverse_momenta(&momenta);
+        let mut start = 0;
+        let types = content
+            .iter()
+            .map(|&(pid, len)| {
+                let len = len as usize;
+                let summary = KinematicSummary::new(
+                    &momenta[start..start + len],
+                    &pts[start..start + len],
+                );
+                let set = TypeSet {
+                    pid,
+                    start,
+                    len,
+                    summary,
+                };
+                start += len;
+                set
+            })
+            .collect();
+        debug_assert_eq!(start, momenta.len());
+        Self {
+            id,
+            weight,
+            signature,
+            types,
+            momenta,
+            pts,
+        }
+    }
+
+    /// Borrow the event
+    pub fn view(&self) -> EventView<'_> {
+        EventView {
+            id: self.id,
+            weight: self.weight,
+            signature: self.signature,
+            types: &self.types,
+            momenta: &self.momenta,
+            pts: &self.pts,
+        }
+    }
+
     /// Access the outgoing particle momenta grouped by particle id
-    pub fn outgoing(&self) -> &[(i32, MomentumSet)] {
-        self.outgoing_by_pid.as_slice()
+    pub fn outgoing(&self) -> Outgoing<'_> {
+        self.view().outgoing()
+    }
+
+    /// Kinematic summaries for the outgoing particles of each type
+    ///
+    /// The summaries are in the same order as the particle types in
+    /// [outgoing](Event::outgoing).
+    pub fn summaries(
+        &self,
+    ) -> impl ExactSizeIterator<Item = &KinematicSummary> {
+        self.types.iter().map(|set| &set.summary)
     }
 
     /// Access the outgoing particle momenta with the given particle id
     pub fn outgoing_with_pid(&self, pid: i32) -> &[FourVector] {
-        let idx = self
-            .outgoing_by_pid
-            .binary_search_by(|probe| pid.cmp(&probe.0));
+        self.view().outgoing_with_pid(pid)
+    }
+
+    /// Extract the outgoing particle momenta grouped by particle id
+    pub fn into_outgoing(self) -> Vec<(i32, MomentumSet)> {
+        self.outgoing().map(|(pid, p)| (pid, p.to_vec())).collect()
+    }
+}
+
+/// Table of event weights indexed by event [id](crate::event::Event::id)
+///
+/// The table extends up to the largest id. Entries for ids without a
+/// corresponding event are `None`.
+pub fn weights_by_id(events: &[Event]) -> Vec<Option<N64>> {
+    let len = events.iter().map(|e| e.id() + 1).max().unwrap_or(0);
+    let mut weights = vec![None; len];
+    for event in events {
+        weights[event.id()] = Some(event.weight);
+    }
+    weights
+}
+
+/// A borrowed [Event]
+///
+/// Views are cheap to copy. They can point either to an [Event] or to
+/// an event inside an [EventArena](crate::event_store::EventArena).
+#[derive(PartialEq, Eq, PartialOrd, Ord, Debug, Clone, Copy)]
+pub struct EventView<'a> {
+    id: usize,
+    pub weight: N64,
+
+    signature: SignatureId,
+    types: &'a [TypeSet],
+    momenta: &'a [FourVector],
+    pts: &'a [N64],
+}
+
+impl<'a> EventView<'a> {
+    pub(crate) fn new(
+        id: usize,
+        weight: N64,
+        signature: SignatureId,
+        types: &'a [TypeSet],
+        momenta: &'a [FourVector],
+        pts: &'a [N64],
+    ) -> Self {
+        debug_assert_eq!(momenta.len(), pts.len());
+        Self {
+            id,
+            weight,
+            signature,
+            types,
+            momenta,
+            pts,
+        }
+    }
+
+    /// Get the event id
+    pub fn id(&self) -> usize {
+        self.id
+    }
+
+    /// The interned signature of the event
+    pub fn signature(&self) -> SignatureId {
+        self.signature
+    }
+
+    /// Access the outgoing particle momenta grouped by particle id
+    pub fn outgoing(&self) -> Outgoing<'a> {
+        Outgoing {
+            types: self.types.iter(),
+            momenta: self.momenta,
+        }
+    }
+
+    /// The particle types with their kinematic summaries
+    ///
+    /// The types are in the same order as in
+    /// [outgoing](EventView::outgoing).
+    pub fn type_sets(&self) -> &'a [TypeSet] {
+        self.types
+    }
+
+    /// Kinematic summaries for the outgoing particles of each type
+    ///
+    /// The summaries are in the same order as the particle types in
+    /// [outgoing](EventView::outgoing).
+    pub fn summaries(
+        &self,
+    ) -> impl ExactSizeIterator<Item = &'a KinematicSummary> {
+        self.types.iter().map(|set| &set.summary)
+    }
+
+    /// Access the outgoing particle momenta of the given type
+    pub fn momenta(&self, set: &TypeSet) -> &'a [FourVector] {
+        set.particles(self.momenta)
+    }
+
+    /// The transverse momenta of the outgoing particles of the given
+    /// type
+    ///
+    /// These are in the same order as the [momenta](EventView::momenta)
+    /// and are only computed once when the event is constructed.
+    pub fn pts(&self, set: &TypeSet) -> &'a [N64] {
+        set.particles(self.pts)
+    }
+
+    /// Access the outgoing particle momenta with the given particle id
+    pub fn outgoing_with_pid(&self, pid: i32) -> &'a [FourVector] {
+        let idx = self.types.binary_search_by(|probe| pid.cmp(&probe.pid));
         if let Ok(idx) = idx {
-            &self.outgoing_by_pid[idx].1
+            self.momenta(&self.types[idx])
         } else {
-            EMPTY_SLICE
+            &[]
         }
     }
 
-    /// Extract the outgoing particle momenta grouped by particle id
-    pub fn into_outgoing(self) -> Vec<(i32, MomentumSet)> {
-        self.outgoing_by_pid
+    /// Copy into an owned [Event]
+    pub fn to_event(&self) -> Event {
+        Event {
+            id: self.id,
+            weight: self.weight,
+            signature: self.signature,
+            types: self.types.to_vec(),
+            momenta: self.momenta.to_vec(),
+            pts: self.pts.to_vec(),
+        }
+    }
+}
+
+impl<'a> From<&'a Event> for EventView<'a> {
+    fn from(event: &'a Event) -> Self {
+        event.view()
+    }
+}
+
+/// Iterator over (particle id, momenta) for all outgoing particle types
+///
+/// The particle ids are in descending order.
+#[derive(Clone, Debug)]
+pub struct Outgoing<'a> {
+    types: std::slice::Iter<'a, TypeSet>,
+    momenta: &'a [FourVector],
+}
+
+impl<'a> Iterator for Outgoing<'a> {
+    type Item = (i32, &'a [FourVector]);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        let set = self.types.next()?;
+        Some((set.pid, set.particles(self.momenta)))
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        self.types.size_hint()
+    }
+}
+
+impl<'a> ExactSizeIterator for Outgoing<'a> {}
+
+impl<'a> DoubleEndedIterator for Outgoing<'a> {
+    fn next_back(&mut self) -> Option<Self::Item> {
+        let set = self.types.next_back()?;
+        Some((set.pid, set.particles(self.momenta)))
     }
 }
@@ -0,0 +1,875 @@
+use crate::cell::SortedCandidates;
+use crate::distance::Distance;
+use crate::event::{Event, EventView, SignatureId, TypeSet};
+use crate::four_vector::FourVector;
+
+use std::convert::TryInto;
+use std::fs::File;
+use std::io::{BufWriter, Write};
+use std::mem::size_of;
+use std::sync::Arc;
+
+use log::{debug, info};
+use memmap2::Mmap;
+use noisy_float::prelude::*;
+use rayon::prelude::*;
+
+/// Number of events that are decoded together from an [Encoded] store
+///
+/// Each block takes a few hundred kilobytes for typical events.
+const BLOCK_SIZE: usize = 1024;
+
+/// Number of nearest candidates kept per seed in one pass over an
+/// [Encoded] store
+///
+/// Events with the same distance as the last candidate are kept as
+/// well. If a cell needs more candidates, another pass is made.
+const CANDIDATES_PER_PASS: usize = 4096;
+
+/// Largest absolute value of a quantised momentum component
+const QUANTISATION_STEPS: f64 = i16::MAX as f64;
+
+/// Events that are either kept in memory or encoded
+#[derive(Debug)]
+pub enum EventStore {
+    InMemory(EventArena),
+    Encoded(Encoded),
+}
+
+impl EventStore {
+    /// Number of events
+    pub fn len(&self) -> usize {
+        match self {
+            EventStore::InMemory(events) => events.len(),
+            EventStore::Encoded(events) => events.len(),
+        }
+    }
+
+    /// Whether there are no events
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Load all events into memory
+    pub fn into_events(self) -> Vec<Event> {
+        match self {
+            EventStore::InMemory(events) => events.to_events(),
+            EventStore::Encoded(events) => events.to_events(),
+        }
+    }
+}
+
+/// Precision of the particle momenta in an [EventStore]
+#[derive(Copy, Clone, PartialEq, Eq, PartialOrd, Ord, Hash, Debug)]
+pub enum Precision {
+    /// Full double precision
+    Double,
+    /// Single precision
+    ///
+    /// Each momentum component has a relative error of at most
+    /// 2^-24 ≈ 6e-8.
+    Single,
+    /// 16-bit integers relative to the largest momentum component in
+    /// each event
+    ///
+    /// Each momentum component has an absolute error of at most about
+    /// 1.5e-5 times the largest absolute momentum component in the
+    /// same event.
+    Half,
+}
+
+impl Default for Precision {
+    fn default() -> Self {
+        Self::Double
+    }
+}
+
+/// Random access to a collection of events
+pub trait Events: Sync {
+    /// Number of events
+    fn len(&self) -> usize;
+
+    /// Whether there are no events
+    fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Borrow the event with the given index
+    fn view(&self, idx: usize) -> EventView<'_>;
+}
+
+impl Events for [Event] {
+    fn len(&self) -> usize {
+        <[Event]>::len(self)
+    }
+
+    fn view(&self, idx: usize) -> EventView<'_> {
+        self[idx].view()
+    }
+}
+
+impl Events for Vec<Event> {
+    fn len(&self) -> usize {
+        Vec::len(self)
+    }
+
+    fn view(&self, idx: usize) -> EventView<'_> {
+        self[idx].view()
+    }
+}
+
+/// Events with the particle data of all events in shared buffers
+///
+/// In contrast to a `Vec<Event>`, this takes a constant number of heap
+/// allocations independent of the number of events, and the momenta
+/// of consecutive events are adjacent in memory. Events are accessed
+/// through [EventView]s.
+#[derive(PartialEq, Eq, PartialOrd, Ord, Debug, Clone, Default)]
+pub struct EventArena {
+    ids: Vec<usize>,
+    weights: Vec<N64>,
+    signatures: Vec<SignatureId>,
+    // the particle types of event `i` are
+    // types[type_offsets[i]..type_offsets[i + 1]],
+    // and likewise for the momenta and transverse momenta
+    type_offsets: Vec<usize>,
+    momentum_offsets: Vec<usize>,
+    types: Vec<TypeSet>,
+    momenta: Vec<FourVector>,
+    pts: Vec<N64>,
+}
+
+impl EventArena {
+    /// Empty arena
+    pub fn new() -> Self {
+        Self {
+            type_offsets: vec![0],
+            momentum_offsets: vec![0],
+            ..Default::default()
+        }
+    }
+
+    /// Add an event
+    pub fn push(&mut self, event: EventView<'_>) {
+        self.ids.push(event.id());
+        self.weights.push(event.weight);
+        self.signatures.push(event.signature());
+        self.types.extend_from_slice(event.type_sets());
+        for set in event.type_sets() {
+            self.momenta.extend_from_slice(event.momenta(set));
+            self.pts.extend_from_slice(event.pts(set));
+        }
+        self.type_offsets.push(self.types.len());
+        self.momentum_offsets.push(self.momenta.len());
+    }
+
+    /// Number of events
+    pub fn len(&self) -> usize {
+        self.ids.len()
+    }
+
+    /// Whether there are no events
+    pub fn is_empty(&self) -> bool {
+        self.ids.is_empty()
+    }
+
+    /// Borrow the event with the given index
+    pub fn view(&self, idx: usize) -> EventView<'_> {
+        let types = self.type_offsets[idx]..self.type_offsets[idx + 1];
+        let momenta =
+            self.momentum_offsets[idx]..self.momentum_offsets[idx + 1];
+        EventView::new(
+            self.ids[idx],
+            self.weights[idx],
+            self.signatures[idx],
+            &self.types[types],
+            &self.momenta[momenta.clone()],
+            &self.pts[momenta],
+        )
+    }
+
+    /// Iterator over all events
+    pub fn iter(&self) -> impl ExactSizeIterator<Item = EventView<'_>> {
+        (0..self.len()).map(move |idx| self.view(idx))
+    }
+
+    /// Event weights
+    pub fn weights(&self) -> &[N64] {
+        &self.weights
+    }
+
+    /// Mutable access to the event weights
+    pub fn weights_mut(&mut self) -> &mut [N64] {
+        &mut self.weights
+    }
+
+    /// Copy all events into owned [Event]s
+    pub fn to_events(&self) -> Vec<Event> {
+        (0..self.len())
+            .into_par_iter()
+            .map(|idx| self.view(idx).to_event())
+            .collect()
+    }
+}
+
+impl Events for EventArena {
+    fn len(&self) -> usize {
+        EventArena::len(self)
+    }
+
+    fn view(&self, idx: usize) -> EventView<'_> {
+        EventArena::view(self, idx)
+    }
+}
+
+impl<'a> FromIterator<EventView<'a>> for EventArena {
+    fn from_iter<I: IntoIterator<Item = EventView<'a>>>(iter: I) -> Self {
+        let mut arena = Self::new();
+        for event in iter {
+            arena.push(event);
+        }
+        arena
+    }
+}
+
+/// Construct an [EventStore] by adding events one at a time
+///
+/// With the default [Precision::Double], events are kept in memory in
+/// an [EventArena] until their estimated memory exceeds the limit.
+/// Then all events are moved to a temporary file. With a lower
+/// precision, events are encoded in a compact format in memory right
+/// away and only moved to a file when the encoded events exceed the
+/// memory limit.
+#[derive(Debug)]
+pub struct EventStoreBuilder {
+    memory_limit: Option<usize>,
+    precision: Precision,
+    mem_size: usize,
+    events: EventArena,
+    encoder: Option<Encoder>,
+}
+
+/// Encodes events into a buffer or a file
+#[derive(Debug)]
+struct Encoder {
+    sink: Sink,
+    precision: Precision,
+    nbytes: u64,
+    // start of each block
+    block_offsets: Vec<u64>,
+    headers: Headers,
+}
+
+#[derive(Debug)]
+enum Sink {
+    Memory(Vec<u8>),
+    File(BufWriter<File>),
+}
+
+impl EventStoreBuilder {
+    /// Keep at most `memory_limit` bytes worth of events in memory
+    ///
+    /// Without a limit, all events are kept in memory.
+    pub fn new(memory_limit: Option<usize>) -> Self {
+        Self {
+            memory_limit,
+            precision: Precision::default(),
+            mem_size: 0,
+            events: EventArena::new(),
+            encoder: None,
+        }
+    }
+
+    /// Set the precision of the stored momenta
+    ///
+    /// This has to be called before adding any events.
+    pub fn precision(self, precision: Precision) -> Self {
+        debug_assert!(self.events.is_empty() && self.encoder.is_none());
+        Self { precision, ..self }
+    }
+
+    /// Add an event
+    pub fn push(&mut self, event: Event) -> Result<(), std::io::Error> {
+        if self.encoder.is_none() && self.precision != Precision::Double {
+            debug!("Storing events with {:?} precision", self.precision);
+            self.encoder =
+                Some(Encoder::new(Sink::Memory(Vec::new()), self.precision));
+        }
+        if let Some(encoder) = &mut self.encoder {
+            encoder.push(event.view())?;
+            return match (&encoder.sink, self.memory_limit) {
+                (Sink::Memory(buf), Some(limit)) if buf.len() > limit => {
+                    self.move_to_disk()
+                }
+                _ => Ok(()),
+            };
+        }
+        self.mem_size += mem_size(event.view());
+        self.events.push(event.view());
+        match self.memory_limit {
+            Some(limit) if self.mem_size > limit => self.move_to_disk(),
+            _ => Ok(()),
+        }
+    }
+
+    /// Finish adding events
+    pub fn build(self) -> Result<EventStore, std::io::Error> {
+        let encoder = if let Some(encoder) = self.encoder {
+            encoder
+        } else {
+            return Ok(EventStore::InMemory(self.events));
+        };
+        let data = match encoder.sink {
+            Sink::Memory(buf) => {
+                info!(
+                    "Stored {} events ({} bytes) in memory",
+                    encoder.headers.len(),
+                    encoder.nbytes
+                );
+                Data::Memory(buf)
+            }
+            Sink::File(file) => {
+                let file = file.into_inner().map_err(|err| err.into_error())?;
+                // SAFETY: the file is an anonymous temporary file that is
+                // never modified after this point
+                let mmap = unsafe { Mmap::map(&file)? };
+                info!(
+                    "Stored {} events ({} bytes) on disk",
+                    encoder.headers.len(),
+                    encoder.nbytes
+                );
+                Data::File { _file: file, mmap }
+            }
+        };
+        Ok(EventStore::Encoded(Encoded {
+            data,
+            precision: encoder.precision,
+            block_offsets: encoder.block_offsets,
+            headers: encoder.headers,
+            signatures: SignatureId::all(),
+        }))
+    }
+
+    fn move_to_disk(&mut self) -> Result<(), std::io::Error> {
+        info!(
+            "Events exceed memory limit of {} bytes, moving them to disk",
+            self.memory_limit.unwrap_or_default()
+        );
+        let mut file = BufWriter::new(tempfile::tempfile()?);
+        if let Some(encoder) = &mut self.encoder {
+            if let Sink::Memory(buf) = &encoder.sink {
+                file.write_all(buf)?;
+            }
+            encoder.sink = Sink::File(file);
+            return Ok(());
+        }
+        let mut encoder = Encoder::new(Sink::File(file), self.precision);
+        for event in self.events.iter() {
+            encoder.push(event)?;
+        }
+        self.events = EventArena::new();
+        self.mem_size = 0;
+        self.encoder = Some(encoder);
+        Ok(())
+    }
+}
+
+impl Encoder {
+    fn new(sink: Sink, precision: Precision) -> Self {
+        Self {
+            sink,
+            precision,
+            nbytes: 0,
+            block_offsets: Vec::new(),
+            headers: Headers::new(precision),
+        }
+    }
+
+    fn push(&mut self, event: EventView<'_>) -> Result<(), std::io::Error> {
+        let idx = self.headers.len();
+        self.headers.push(event.id(), event.weight)?;
+        if idx % BLOCK_SIZE == 0 {
+            self.block_offsets.push(self.nbytes);
+        }
+        let signature = event.signature().index();
+        self.nbytes += match &mut self.sink {
+            Sink::Memory(buf) => {
+                write_event(buf, event, signature, self.precision)?
+            }
+            Sink::File(file) => {
+                write_event(file, event, signature, self.precision)?
+            }
+        };
+        Ok(())
+    }
+}
+
+#[derive(Debug)]
+enum Data {
+    Memory(Vec<u8>),
+    File { _file: File, mmap: Mmap },
+}
+
+impl Data {
+    fn bytes(&self) -> &[u8] {
+        match self {
+            Data::Memory(buf) => buf,
+            Data::File { mmap, .. } => mmap,
+        }
+    }
+}
+
+/// Events stored in a compact encoding, either in memory or in a
+/// memory-mapped file
+///
+/// Only the ids and weights are kept as [Headers]. The particle momenta
+/// are decoded in blocks of consecutive events when needed.
+#[derive(Debug)]
+pub struct Encoded {
+    data: Data,
+    precision: Precision,
+    block_offsets: Vec<u64>,
+    headers: Headers,
+    // all interned signatures, indexed by their identifiers
+    signatures: Vec<Arc<[(i32, u32)]>>,
+}
+
+impl Encoded {
+    /// Number of events
+    pub fn len(&self) -> usize {
+        self.headers.len()
+    }
+
+    /// Whether there are no events
+    pub fn is_empty(&self) -> bool {
+        self.headers.is_empty()
+    }
+
+    /// Whether the events are stored in a file
+    pub fn is_on_disk(&self) -> bool {
+        matches!(self.data, Data::File { .. })
+    }
+
+    /// Precision of the stored momenta
+    pub fn precision(&self) -> Precision {
+        self.precision
+    }
+
+    /// Events without particles, only with their ids and weights
+    pub fn headers(&self) -> &Headers {
+        &self.headers
+    }
+
+    /// Decode the event with the given index
+    pub fn event(&self, idx: usize) -> Event {
+        let mut block = self.block(idx / BLOCK_SIZE);
+        block.swap_remove(idx % BLOCK_SIZE)
+    }
+
+    /// Decode all events
+    pub fn to_events(&self) -> Vec<Event> {
+        (0..self.block_offsets.len())
+            .into_par_iter()
+            .flat_map_iter(|b| self.block(b))
+            .collect()
+    }
+
+    /// Nearest neighbours of each seed
+    ///
+    /// For each (index, event) pair in `seeds`, this returns the other
+    /// events with a distance of at most `bound` in order of increasing
+    /// distance. The first candidates for all seeds are found in a
+    /// single pass over the stored events. Each pass only keeps a
+    /// bounded number of candidates per seed, further passes for
+    /// individual seeds are made when needed.
+    pub fn nearest<'a, D: Distance + Sync>(
+        &'a self,
+        seeds: Vec<(usize, Event)>,
+        distance: &'a D,
+        bound: N64,
+    ) -> Vec<Nearest<'a, D>> {
+        debug!("Computing distances for {} seeds", seeds.len());
+        let cutoffs = vec![None; seeds.len()];
+        let candidates = self.candidates(&seeds, distance, bound, &cutoffs);
+        seeds
+            .into_iter()
+            .zip(candidates)
+            .map(|(seed, candidates)| Nearest {
+                store: self,
+                distance,
+                bound,
+                seed,
+                cutoff: None,
+                candidates: SortedCandidates::new(Vec::new()),
+                next_candidates: Some(candidates),
+            })
+            .collect()
+    }
+
+    // One pass over all events to find the nearest candidates for
+    // each seed with a distance above the seed's cutoff
+    fn candidates<D: Distance + Sync>(
+        &self,
+        seeds: &[(usize, Event)],
+        distance: &D,
+        bound: N64,
+        cutoffs: &[Option<N64>],
+    ) -> Vec<Vec<(N64, usize)>> {
+        let nseeds = seeds.len();
+        (0..self.block_offsets.len())
+            .into_par_iter()
+            .map(|b| {
+                let start = b * BLOCK_SIZE;
+                let events = self.block(b);
+                seeds
+                    .iter()
+                    .zip(cutoffs)
+                    .map(|((seed_idx, seed), cutoff)| {
+                        let mut dists: Vec<_> = events
+                            .iter()
+                            .enumerate()
+                            .map(|(n, e)| (start + n, e))
+                            .filter(|(idx, _)| idx != seed_idx)
+                            .filter_map(|(idx, e)| {
+                                let dist = distance.distance_bounded(
+                                    e.view(),
+                                    seed.view(),
+                                    bound,
+                                )?;
+                                Some((dist, idx))
+                            })
+                            .filter(|(dist, _)| Some(*dist) > *cutoff)
+                            .collect();
+                        keep_nearest(&mut dists, CANDIDATES_PER_PASS);
+                        dists
+                    })
+                    .collect()
+            })
+            .reduce(
+                || vec![Vec::new(); nseeds],
+                |mut acc, block| {
+                    for (acc, block) in acc.iter_mut().zip(block) {
+                        acc.extend(block);
+                        keep_nearest(acc, CANDIDATES_PER_PASS);
+                    }
+                    acc
+                },
+            )
+    }
+
+    fn block(&self, b: usize) -> Vec<Event> {
+        let start = b * BLOCK_SIZE;
+        let end = std::cmp::min(start + BLOCK_SIZE, self.len());
+        let mut pos = self.block_offsets[b] as usize;
+        (start..end)
+            .map(|idx| {
+                read_event(
+                    self.data.bytes(),
+                    &mut pos,
+                    self.headers.view(idx),
+                    &self.signatures,
+                    self.precision,
+                )
+            })
+            .collect()
+    }
+}
+
+/// Ids and weights of [Encoded] events
+///
+/// With [Precision::Single] and [Precision::Half], ids are stored as
+/// 32-bit integers, so each event takes 12 bytes. Events spilled to
+/// disk with [Precision::Double] keep 64-bit ids. Headers are
+/// accessed as [Events] without particles.
+#[derive(PartialEq, Eq, PartialOrd, Ord, Debug, Clone)]
+pub struct Headers {
+    ids: Ids,
+    weights: Vec<N64>,
+}
+
+#[derive(PartialEq, Eq, PartialOrd, Ord, Debug, Clone)]
+enum Ids {
+    Compact(Vec<u32>),
+    Full(Vec<u64>),
+}
+
+impl Headers {
+    fn new(precision: Precision) -> Self {
+        let ids = match precision {
+            Precision::Double => Ids::Full(Vec::new()),
+            Precision::Single | Precision::Half => Ids::Compact(Vec::new()),
+        };
+        Self {
+            ids,
+            weights: Vec::new(),
+        }
+    }
+
+    fn push(&mut self, id: usize, weight: N64) -> Result<(), std::io::Error> {
+        match &mut self.ids {
+            Ids::Compact(ids) => {
+                let id = u32::try_from(id).map_err(|_| {
+                    std::io::Error::new(
+                        std::io::ErrorKind::InvalidInput,
+                        format!(
+                            "Event id {id} does not fit into 32 bits, \
+                             use double precision instead"
+                        ),
+                    )
+                })?;
+                ids.push(id)
+            }
+            Ids::Full(ids) => ids.push(id as u64),
+        }
+        self.weights.push(weight);
+        Ok(())
+    }
+
+    /// Number of events
+    pub fn len(&self) -> usize {
+        self.weights.len()
+    }
+
+    /// Whether there are no events
+    pub fn is_empty(&self) -> bool {
+        self.weights.is_empty()
+    }
+
+    fn id(&self, idx: usize) -> usize {
+        match &self.ids {
+            Ids::Compact(ids) => ids[idx] as usize,
+            Ids::Full(ids) => ids[idx] as usize,
+        }
+    }
+
+    /// Event weights
+    pub fn weights(&self) -> &[N64] {
+        &self.weights
+    }
+}
+
+impl Events for Headers {
+    fn len(&self) -> usize {
+        Headers::len(self)
+    }
+
+    fn view(&self, idx: usize) -> EventView<'_> {
+        EventView::new(
+            self.id(idx),
+            self.weights[idx],
+            SignatureId::default(),
+            &[],
+            &[],
+            &[],
+        )
+    }
+}
+
+/// Nearest neighbours of a seed among [Encoded] events
+///
+/// This iterator yields (distance, index) pairs in order of
+/// increasing distance from the seed, see [Encoded::nearest].
+pub struct Nearest<'a, D> {
+    store: &'a Encoded,
+    distance: &'a D,
+    bound: N64,
+    seed: (usize, Event),
+    // largest distance of all candidates found so far, or `None` if
+    // there are no events beyond them
+    cutoff: Option<N64>,
+    candidates: SortedCandidates,
+    // candidates from the last pass, `None` once all events have
+    // been found
+    next_candidates: Option<Vec<(N64, usize)>>,
+}
+
+impl<'a, D: Distance + Sync> Iterator for Nearest<'a, D> {
+    type Item = (N64, usize);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        loop {
+            if let Some(next) = self.candidates.next() {
+                return Some(next);
+            }
+            let candidates = match self.next_candidates.take() {
+                Some(candidates) => candidates,
+                None => {
+                    // all earlier passes were complete
+                    self.cutoff?;
+                    debug!("Searching for more cell candidates");
+                    let seeds = std::slice::from_ref(&self.seed);
+                    let cutoffs = [self.cutoff];
+                    self.store
+                        .candidates(seeds, self.distance, self.bound, &cutoffs)
+                        .pop()
+                        .unwrap()
+                }
+            };
+            if candidates.len() < CANDIDATES_PER_PASS {
+                // there are no events beyond these candidates
+                self.cutoff = None;
+            } else {
+                self.cutoff = candidates.iter().map(|(dist, _)| *dist).max();
+            }
+            if candidates.is_empty() {
+                return None;
+            }
+            self.candidates = SortedCandidates::new(candidates);
+        }
+    }
+}
+
+/// Keep the `n` smallest (distance, index) pairs and all pairs with
+/// the same distance as the largest of them
+fn keep_nearest(dists: &mut Vec<(N64, usize)>, n: usize) {
+    if dists.len() <= n {
+        return;
+    }
+    dists.select_nth_unstable(n - 1);
+    let max_dist = dists[n - 1].0;
+    let mut len = n;
+    for idx in n..dists.len() {
+        if dists[idx].0 == max_dist {
+            dists.swap(len, idx);
+            len += 1;
+        }
+    }
+    dists.truncate(len);
+}
+
+/// Estimated memory used by an event in an [EventArena]
+fn mem_size(event: EventView<'_>) -> usize {
+    let particles: usize = event
+        .outgoing()
+        .map(|(_, p)| {
+            size_of::<TypeSet>()
+                + p.len() * (size_of::<FourVector>() + size_of::<N64>())
+        })
+        .sum();
+    // id, weight, signature, and offsets into the type and momentum
+    // buffers
+    let header = 3 * size_of::<usize>() + size_of::<N64>();
+    header + size_of::<SignatureId>() + particles
+}
+
+// Events are stored as
+// signature index (u32)
+// for Precision::Half: scale (f32)
+// for each particle: four-momentum (4 components)
+// in little-endian byte order. The components are f64 or f32 for
+// double and single precision. For half precision, each component is
+// stored as an i16 in units of scale / QUANTISATION_STEPS. The id and
+// weight are kept in memory.
+
+fn write_event<W: Write>(
+    w: &mut W,
+    event: EventView<'_>,
+    signature: u32,
+    precision: Precision,
+) -> std::io::Result<u64> {
+    let momenta = event.outgoing().flat_map(|(_, p)| p);
+    let mut nbytes = size_of::<u32>();
+    w.write_all(&signature.to_le_bytes())?;
+    match precision {
+        Precision::Double => {
+            for p in momenta {
+                for i in 0..4 {
+                    w.write_all(&f64::from(p[i]).to_le_bytes())?;
+                }
+                nbytes += 4 * size_of::<f64>();
+            }
+        }
+        Precision::Single => {
+            for p in momenta {
+                for i in 0..4 {
+                    let c = f64::from(p[i]) as f32;
+                    w.write_all(&c.to_le_bytes())?;
+                }
+                nbytes += 4 * size_of::<f32>();
+            }
+        }
+        Precision::Half => {
+            let scale = momenta
+                .clone()
+                .flat_map(|p| (0..4).map(move |i| f64::from(p[i]).abs()))
+                .fold(0., f64::max) as f32;
+            w.write_all(&scale.to_le_bytes())?;
+            nbytes += size_of::<f32>();
+            let step = f64::from(scale) / QUANTISATION_STEPS;
+            for p in momenta {
+                for i in 0..4 {
+                    let q = if step > 0. {
+                        (f64::from(p[i]) / step)
+                            .round()
+                            .clamp(-QUANTISATION_STEPS, QUANTISATION_STEPS)
+                            as i16
+                    } else {
+                        0
+                    };
+                    w.write_all(&q.to_le_bytes())?;
+                }
+                nbytes += 4 * size_of::<i16>();
+            }
+        }
+    }
+    Ok(nbytes as u64)
+}
+
+fn read_event(
+    buf: &[u8],
+    pos: &mut usize,
+    header: EventView<'_>,
+    signatures: &[Arc<[(i32, u32)]>],
+    precision: Precision,
+) -> Event {
+    let signature = read_u32(buf, pos);
+    let content = &signatures[signature as usize];
+    let step = match precision {
+        Precision::Half => {
+            let scale = f32::from_le_bytes(read_bytes(buf, pos));
+            f64::from(scale) / QUANTISATION_STEPS
+        }
+        _ => 0.,
+    };
+    let nparticles = content.iter().map(|(_, n)| *n as usize).sum();
+    // the momenta were written in the order of the signature
+    let momenta = (0..nparticles)
+        .map(|_| {
+            let mut p = [n64(0.); 4];
+            for p in &mut p {
+                let c = match precision {
+                    Precision::Double => {
+                        f64::from_le_bytes(read_bytes(buf, pos))
+                    }
+                    Precision::Single => {
+                        f32::from_le_bytes(read_bytes(buf, pos)).into()
+                    }
+                    Precision::Half => {
+                        step * f64::from(i16::from_le_bytes(read_bytes(
+                            buf, pos,
+                        )))
+                    }
+                };
+                *p = n64(c);
+            }
+            p.into()
+        })
+        .collect();
+    Event::from_signature(
+        header.id(),
+        header.weight,
+        SignatureId::from_index(signature),
+        content,
+        momenta,
+    )
+}
+
+fn read_u32(buf: &[u8], pos: &mut usize) -> u32 {
+    u32::from_le_bytes(read_bytes(buf, pos))
+}
+
+fn read_bytes<const N: usize>(buf: &[u8], pos: &mut usize) -> [u8; N] {
+    let bytes = buf[*pos..*pos + N].try_into().unwrap();
+    *pos += N;
+    bytes
+}
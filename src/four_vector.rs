@@ -4,9 +4,12 @@ use noisy_float::prelude::*;
 ///
 /// The zero component is the energy/time component. The remainder are
 /// the spatial components
-#[derive(PartialEq, Eq, PartialOrd, Ord, Debug, Clone, Copy, Default)]
+///
+/// Only the four components are stored, so a four-vector takes 32
+/// bytes. Derived quantities like the transverse momentum are computed
+/// on demand.
+#[derive(PartialEq, Eq, Debug, Clone, Copy, Default)]
 pub struct FourVector {
-    pt: N64,
     p: [N64; 4],
 }
 
@@ -36,27 +39,36 @@ impl FourVector {
     }
 
     /// The scalar transverse momentum
+    ///
+    /// This is recomputed on each call and involves a square root.
+    /// Events store the transverse momenta of their particles, see
+    /// [EventView::pts](crate::event::EventView::pts).
     pub fn pt(&self) -> N64 {
-        self.pt
+        (self.p[1] * self.p[1] + self.p[2] * self.p[2]).sqrt()
     }
 
     const fn len() -> usize {
         4
     }
+}
+
+/// Four-vectors are ordered by transverse momentum first and then by
+/// their components
+impl std::cmp::Ord for FourVector {
+    fn cmp(&self, other: &Self) -> std::cmp::Ordering {
+        (self.pt(), self.p).cmp(&(other.pt(), other.p))
+    }
+}
 
-    fn update_pt(&mut self) {
-        self.pt = (self.p[1] * self.p[1] + self.p[2] * self.p[2]).sqrt();
+impl std::cmp::PartialOrd for FourVector {
+    fn partial_cmp(&self, other: &Self) -> Option<std::cmp::Ordering> {
+        Some(self.cmp(other))
     }
 }
 
 impl std::convert::From<[N64; 4]> for FourVector {
     fn from(p: [N64; 4]) -> FourVector {
-        let mut res = FourVector {
-            p,
-            pt: std::default::Default::default(),
-        };
-        res.update_pt();
-        res
+        FourVector { p }
     }
 }
 
@@ -73,7 +85,6 @@ impl std::ops::AddAssign for FourVector {
         for i in 0..Self::len() {
             self.p[i] += rhs[i]
         }
-        self.update_pt();
     }
 }
 
@@ -82,7 +93,6 @@ impl std::ops::SubAssign for FourVector {
         for i in 0..Self::len() {
             self.p[i] -= rhs[i]
         }
-        self.update_pt();
     }
 }
 
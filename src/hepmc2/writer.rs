@@ -7,7 +7,6 @@ use std::rc::Rc;
 
 use crate::cell_collector::CellCollector;
 use crate::compression::{compress_writer, Compression};
-use crate::event::Event;
 use crate::progress_bar::{Progress, ProgressBar};
 use crate::traits::Write;
 
@@ -53,29 +52,29 @@ where
 {
     type Error = WriteError<E>;
 
-    /// Write all `events`.
+    /// Write out the events with the given `weights`
     ///
-    /// `events` has to be sorted by [id](crate::event::Event::id). The
+    /// `weights` is indexed by event [id](crate::event::Event::id), see
+    /// [weights_by_id](crate::event::weights_by_id). The
     /// [Cres](crate::cres::Cres) struct does this automatically.
     ///
-    /// For each event `e` in `events`, we read events from `reader`
-    /// until the number of read events matches `e.id() + 1`. We then
-    /// adjust the weight and cross section of the last read event and
-    /// write it out.
+    /// We read the events from `reader` in order. For each event with a
+    /// weight, we adjust the weight and cross section and write it out.
+    /// Events without a weight are skipped.
     fn write(
         &mut self,
         reader: &mut R,
-        events: &[Event],
+        weights: &[Option<N64>],
     ) -> Result<(), Self::Error> {
         use WriteError::*;
 
         let writer = compress_writer(&mut self.writer, self.compression)?;
         let mut writer = hepmc2::Writer::try_from(writer)?;
 
-        let sum_wt: N64 = events.par_iter().map(|e| e.weight).sum();
+        let sum_wt: N64 = weights.par_iter().filter_map(|w| *w).sum();
         let xs = n64(self.weight_norm) * sum_wt;
         let sum_wtsqr: N64 =
-            events.par_iter().map(|e| e.weight * e.weight).sum();
+            weights.par_iter().filter_map(|w| *w).map(|w| w * w).sum();
         let xs_err = n64(self.weight_norm) * sum_wtsqr.sqrt();
         info!("Final cross section: σ = {:.3e} ± {:.3e}", xs, xs_err);
 
@@ -96,19 +95,16 @@ where
             }
         }
 
-        let mut hepmc_events = reader.enumerate();
-        let progress = ProgressBar::new(events.len() as u64, "events written:");
-        for event in events {
-            let (hepmc_id, hepmc_event) = hepmc_events.next().unwrap();
+        let nevents = weights.par_iter().filter_map(|w| *w).count();
+        let progress = ProgressBar::new(nevents as u64, "events written:");
+        for (id, (hepmc_event, weight)) in reader.zip(weights).enumerate() {
             let mut hepmc_event = hepmc_event.map_err(ReadErr)?;
-            if hepmc_id < event.id() {
-                for _ in hepmc_id..event.id() {
-                    let (_id, ev) = hepmc_events.next().unwrap();
-                    hepmc_event = ev.map_err(ReadErr)?;
-                }
-            }
+            let weight = match weight {
+                Some(weight) => *weight,
+                None => continue,
+            };
             let old_weight = hepmc_event.weights.first().unwrap();
-            let reweight: f64 = (event.weight / old_weight).into();
+            let reweight: f64 = (weight / old_weight).into();
             for weight in &mut hepmc_event.weights {
                 *weight *= reweight
             }
@@ -117,7 +113,7 @@ where
             writer.write(&hepmc_event)?;
             if let Some(dump_event_to) = dump_event_to.as_ref() {
                 let cellnums: &[usize] = dump_event_to
-                    .get(&event.id())
+                    .get(&id)
                     .map(|v: &Vec<usize>| v.as_slice())
                     .unwrap_or_default();
                 for cellnum in cellnums {
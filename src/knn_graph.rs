@@ -0,0 +1,191 @@
+use crate::cell::SortedCandidates;
+use crate::distance::Distance;
+use crate::event_store::Events;
+
+use log::debug;
+use noisy_float::prelude::*;
+use rayon::prelude::*;
+
+/// The nearest neighbours of all negative-weight events
+///
+/// For each event with negative weight, the `k` nearest events and
+/// their distances are computed in a single parallel pass and stored
+/// as a compressed sparse row (CSR) neighbour list. Cells that need
+/// more neighbours fall back to computing the distances to all
+/// events.
+#[derive(Clone, Debug)]
+pub struct KnnGraph {
+    // the neighbours of event `i` are
+    // neighbours[offsets[i]..offsets[i + 1]]
+    offsets: Vec<usize>,
+    neighbours: Vec<(N64, usize)>,
+}
+
+impl KnnGraph {
+    /// Compute the `k` nearest neighbours of all negative-weight events
+    pub fn new<E: Events + ?Sized, D: Distance + Sync>(
+        events: &E,
+        distance: &D,
+        k: usize,
+    ) -> Self {
+        let nneg = (0..events.len())
+            .filter(|&idx| events.view(idx).weight < 0.)
+            .count();
+        debug!("Computing {} nearest neighbours for {} events", k, nneg);
+        let rows: Vec<_> = (0..events.len())
+            .into_par_iter()
+            .map(|idx| {
+                if events.view(idx).weight < 0. {
+                    k_nearest(events, idx, distance, k)
+                } else {
+                    Vec::new()
+                }
+            })
+            .collect();
+        let mut offsets = Vec::with_capacity(events.len() + 1);
+        offsets.push(0);
+        let mut neighbours = Vec::with_capacity(nneg * k);
+        for row in rows {
+            neighbours.extend(row);
+            offsets.push(neighbours.len());
+        }
+        Self {
+            offsets,
+            neighbours,
+        }
+    }
+
+    /// Number of events
+    pub fn len(&self) -> usize {
+        self.offsets.len() - 1
+    }
+
+    /// Whether there are no events
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// All events except for the seed in order of increasing distance
+    ///
+    /// If the stored neighbours of the seed are not sufficient, the
+    /// distances to all remaining events are computed.
+    pub fn nearest<'a, E: Events + ?Sized, D: Distance + Sync>(
+        &'a self,
+        events: &'a E,
+        seed_idx: usize,
+        distance: &'a D,
+    ) -> Nearest<'a, D, E> {
+        debug_assert_eq!(events.len(), self.len());
+        let row = &self.neighbours
+            [self.offsets[seed_idx]..self.offsets[seed_idx + 1]];
+        let (known, boundary) = if row.len() + 1 >= events.len() {
+            (row, None)
+        } else if let Some((max_dist, _)) = row.last() {
+            // other events could have the same distance as the last
+            // stored neighbour, so we only rely on strictly closer ones
+            let nknown = row.partition_point(|(dist, _)| dist < max_dist);
+            (&row[..nknown], Some(*max_dist))
+        } else {
+            (row, Some(N64::neg_infinity()))
+        };
+        Nearest {
+            events,
+            seed_idx,
+            distance,
+            known: known.iter(),
+            boundary,
+            rest: None,
+        }
+    }
+}
+
+fn k_nearest<E: Events + ?Sized, D: Distance>(
+    events: &E,
+    seed_idx: usize,
+    distance: &D,
+    k: usize,
+) -> Vec<(N64, usize)> {
+    if k == 0 {
+        return Vec::new();
+    }
+    let seed = events.view(seed_idx);
+    let mut dists: Vec<_> = (0..events.len())
+        .filter(|&idx| idx != seed_idx)
+        .map(|idx| (distance.distance(events.view(idx), seed), idx))
+        .collect();
+    if dists.len() > k {
+        dists.select_nth_unstable(k - 1);
+        dists.truncate(k);
+        dists.shrink_to_fit();
+    }
+    dists.sort_unstable();
+    dists
+}
+
+/// Search for nearest neighbours using a [KnnGraph]
+///
+/// This iterator yields (distance, index) pairs in order of
+/// increasing distance from the seed.
+pub struct Nearest<'a, D, E: ?Sized> {
+    events: &'a E,
+    seed_idx: usize,
+    distance: &'a D,
+    // stored neighbours that are closer than all other events
+    known: std::slice::Iter<'a, (N64, usize)>,
+    // events with a distance below this are in `known`
+    boundary: Option<N64>,
+    rest: Option<SortedCandidates>,
+}
+
+impl<'a, D, E> Nearest<'a, D, E>
+where
+    D: Distance + Sync,
+    E: Events + ?Sized,
+{
+    /// Whether distances to events outside the graph had to be computed
+    pub fn fell_back(&self) -> bool {
+        self.rest.is_some()
+    }
+
+    /// Lower bound on the distance of the next neighbour, if it is
+    /// known without computing distances to events outside the graph
+    pub fn next_bound(&self) -> Option<N64> {
+        if let Some((dist, _)) = self.known.as_slice().first() {
+            return Some(*dist);
+        }
+        match (self.boundary, &self.rest) {
+            // there are no neighbours left
+            (None, _) => Some(N64::infinity()),
+            (Some(boundary), None) => Some(boundary),
+            (Some(_), Some(_)) => None,
+        }
+    }
+}
+
+impl<'a, D, E> Iterator for Nearest<'a, D, E>
+where
+    D: Distance + Sync,
+    E: Events + ?Sized,
+{
+    type Item = (N64, usize);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if let Some(next) = self.known.next() {
+            return Some(*next);
+        }
+        let boundary = self.boundary?;
+        if self.rest.is_none() {
+            let seed_idx = self.seed_idx;
+            let seed = self.events.view(seed_idx);
+            let (events, distance) = (self.events, self.distance);
+            let order = (0..events.len())
+                .into_par_iter()
+                .filter(|&idx| idx != seed_idx)
+                .map(|idx| (distance.distance(events.view(idx), seed), idx))
+                .filter(|(dist, _)| *dist >= boundary)
+                .collect();
+            self.rest = Some(SortedCandidates::new(order));
+        }
+        self.rest.as_mut().unwrap().next()
+    }
+}
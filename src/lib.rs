@@ -26,19 +26,31 @@ pub mod c_api;
 /// Definition of event cells
 pub mod cell;
 pub mod cell_collector;
+/// Single-precision event copy for nearest-neighbour search
+pub mod compact_events;
 /// Output compression
 pub mod compression;
 pub mod cres;
 /// Distance functions
 pub mod distance;
+/// Cache for distances between events
+pub mod distance_cache;
 /// Scattering event class
 pub mod event;
+/// Event storage, possibly on disk
+pub mod event_store;
 /// Thin wrapper around [std::fs::File]
 pub mod file;
 /// Four-vector class
 pub mod four_vector;
 /// HepMC2 interface
 pub mod hepmc2;
+/// Nearest-neighbour graph for negative-weight events
+pub mod knn_graph;
+/// Lazy nearest-neighbour search shared by several search indices
+pub mod nearest;
+/// Pivot table for nearest-neighbour search
+pub mod pivot_table;
 /// Most important exports
 pub mod prelude;
 /// Progress bar
@@ -47,10 +59,16 @@ pub mod progress_bar;
 pub mod resampler;
 /// Cell seed selection
 pub mod seeds;
+/// Grouping of events by particle type signature
+pub mod signature_buckets;
+/// Vectorised distance kernels
+mod simd;
 /// Common traits
 pub mod traits;
 /// Unweighting
 pub mod unweight;
+/// Vantage-point tree for nearest-neighbour search
+pub mod vp_tree;
 
 use lazy_static::lazy_static;
 
@@ -0,0 +1,136 @@
+use crate::cell::SortedCandidates;
+use crate::distance::Distance;
+use crate::event_store::Events;
+
+use std::cmp::Reverse;
+use std::collections::BinaryHeap;
+use std::iter::Peekable;
+
+use noisy_float::prelude::*;
+
+/// Candidates for nearest neighbours with lower bounds on their distance
+///
+/// This is the interface between the search indices and [LazyNearest].
+pub trait Candidates {
+    /// Lower bound on the distance of all remaining candidates
+    ///
+    /// Returns `None` if there are no candidates left.
+    fn next_bound(&mut self) -> Option<N64>;
+
+    /// Compute the distances for the candidates with the lowest bound
+    ///
+    /// The (distance, index) pairs are added to `dists`. Returns the
+    /// number of computed distances.
+    fn visit_next(
+        &mut self,
+        dists: &mut BinaryHeap<Reverse<(N64, usize)>>,
+    ) -> usize;
+}
+
+/// Nearest-neighbour search over lazily evaluated [Candidates]
+///
+/// This iterator yields (distance, index) pairs in order of
+/// increasing distance from the seed. Distances are only computed
+/// once the lower bound of the remaining candidates is not sufficient
+/// to decide on the next neighbour.
+pub struct LazyNearest<C> {
+    candidates: C,
+    dists: BinaryHeap<Reverse<(N64, usize)>>,
+    nevaluations: usize,
+    approx_factor: N64,
+}
+
+impl<C: Candidates> LazyNearest<C> {
+    /// Search the given candidates
+    ///
+    /// Neighbours are returned once their distance is at most
+    /// `approx_factor` times the lower bound on the distance of the
+    /// remaining candidates.
+    pub(crate) fn new(candidates: C, approx_factor: N64) -> Self {
+        Self {
+            candidates,
+            dists: BinaryHeap::new(),
+            nevaluations: 0,
+            approx_factor,
+        }
+    }
+
+    /// Number of distances computed so far
+    pub fn nevaluations(&self) -> usize {
+        self.nevaluations
+    }
+}
+
+impl<C: Candidates> Iterator for LazyNearest<C> {
+    type Item = (N64, usize);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        loop {
+            let next_bound = self.candidates.next_bound();
+            match (self.dists.peek(), next_bound) {
+                (None, None) => return None,
+                (Some(Reverse((dist, _))), Some(bound))
+                    if *dist > self.approx_factor * bound => {}
+                (Some(_), _) => return self.dists.pop().map(|Reverse(d)| d),
+                (None, Some(_)) => {}
+            }
+            self.nevaluations += self.candidates.visit_next(&mut self.dists);
+        }
+    }
+}
+
+/// Single events ordered by a lower bound on their distance to the seed
+pub struct EventCandidates<'a, D, E: ?Sized> {
+    events: &'a E,
+    seed_idx: usize,
+    distance: &'a D,
+    bounds: Peekable<SortedCandidates>,
+}
+
+impl<'a, D, E: ?Sized> EventCandidates<'a, D, E> {
+    /// Candidates from (lower bound, event index) pairs
+    pub(crate) fn new(
+        events: &'a E,
+        seed_idx: usize,
+        distance: &'a D,
+        bounds: Vec<(N64, usize)>,
+    ) -> Self {
+        Self {
+            events,
+            seed_idx,
+            distance,
+            bounds: SortedCandidates::new(bounds).peekable(),
+        }
+    }
+}
+
+impl<'a, D, E> Candidates for EventCandidates<'a, D, E>
+where
+    D: Distance,
+    E: Events + ?Sized,
+{
+    fn next_bound(&mut self) -> Option<N64> {
+        self.bounds.peek().map(|(bound, _)| *bound)
+    }
+
+    fn visit_next(
+        &mut self,
+        dists: &mut BinaryHeap<Reverse<(N64, usize)>>,
+    ) -> usize {
+        let (_, idx) = self.bounds.next().unwrap();
+        let dist = self
+            .distance
+            .distance(self.events.view(idx), self.events.view(self.seed_idx));
+        dists.push(Reverse((dist, idx)));
+        1
+    }
+}
+
+/// Factor (1 + `epsilon`) by which approximate neighbours may be farther away
+///
+/// With this factor, each neighbour returned by a search is at most
+/// a factor (1 + `epsilon`) farther away from the seed than any event
+/// returned after it.
+pub(crate) fn approx_factor(epsilon: f64) -> N64 {
+    n64(1. + epsilon)
+}
@@ -0,0 +1,134 @@
+use crate::distance::{triangle_lower_bound, Distance};
+use crate::event_store::Events;
+use crate::nearest::{approx_factor, EventCandidates, LazyNearest};
+
+use log::debug;
+use noisy_float::prelude::*;
+use rayon::prelude::*;
+
+/// Distances between all events and a small set of pivot events
+///
+/// This is the approximating and eliminating search algorithm (LAESA)
+/// of M. L. Micó, J. Oncina, E. Vidal, Pattern Recognition Letters
+/// 15 (1994) 9.
+///
+/// By the triangle inequality, |d(s, p) - d(x, p)| is a lower bound
+/// on the distance d(s, x) between a seed s and an event x for any
+/// pivot p. Nearest-neighbour searches only compute d(s, x) for
+/// events where this bound is below the distance of the next
+/// neighbour. The search is exact if the distance is symmetric and
+/// satisfies the triangle inequality, unless an approximation is
+/// requested with [with_epsilon](PivotTable::with_epsilon).
+#[derive(Clone, Debug)]
+pub struct PivotTable {
+    pivots: Vec<usize>,
+    // row-major matrix with the distances between each event and
+    // each pivot
+    dists: Vec<N64>,
+    approx_factor: N64,
+}
+
+impl PivotTable {
+    /// Construct a new table with (up to) `npivots` pivots
+    ///
+    /// Pivots are chosen greedily such that each new pivot has the
+    /// largest sum of distances to the previous ones.
+    pub fn new<E: Events + ?Sized, D: Distance + Sync>(
+        events: &E,
+        distance: &D,
+        npivots: usize,
+    ) -> Self {
+        let npivots = std::cmp::min(npivots, events.len());
+        debug!("Computing distances to {} pivot events", npivots);
+        let mut dists = vec![n64(0.); npivots * events.len()];
+        let mut dist_sums = vec![n64(0.); events.len()];
+        let mut pivots = Vec::with_capacity(npivots);
+        let mut pivot = 0;
+        for n in 0..npivots {
+            pivots.push(pivot);
+            let p = events.view(pivot);
+            dists
+                .par_chunks_mut(npivots)
+                .zip(dist_sums.par_iter_mut())
+                .enumerate()
+                .for_each(|(idx, (dists, sum))| {
+                    dists[n] = distance.distance(events.view(idx), p);
+                    *sum += dists[n];
+                });
+            pivot = dist_sums
+                .par_iter()
+                .enumerate()
+                .filter(|(idx, _)| !pivots.contains(idx))
+                .max_by_key(|(_, sum)| *sum)
+                .map(|(idx, _)| idx)
+                .unwrap_or_default();
+        }
+        Self {
+            pivots,
+            dists,
+            approx_factor: n64(1.),
+        }
+    }
+
+    /// Allow approximate nearest neighbours
+    ///
+    /// Distances are accepted as soon as they are within a factor
+    /// (1 + `epsilon`) of the smallest remaining pivot bound.
+    pub fn with_epsilon(self, epsilon: f64) -> Self {
+        Self {
+            approx_factor: approx_factor(epsilon),
+            ..self
+        }
+    }
+
+    /// Indices of the pivot events
+    pub fn pivots(&self) -> &[usize] {
+        &self.pivots
+    }
+
+    /// All events except for the seed in order of increasing distance
+    pub fn nearest<'a, E: Events + ?Sized, D: Distance>(
+        &'a self,
+        events: &'a E,
+        seed_idx: usize,
+        distance: &'a D,
+    ) -> Nearest<'a, D, E> {
+        let bounds = if self.pivots.is_empty() {
+            (0..events.len())
+                .filter(|&idx| idx != seed_idx)
+                .map(|idx| (n64(0.), idx))
+                .collect()
+        } else {
+            let npivots = self.pivots.len();
+            let seed_dists = self.pivot_dists(seed_idx);
+            self.dists
+                .par_chunks(npivots)
+                .enumerate()
+                .filter(|(idx, _)| *idx != seed_idx)
+                .map(|(idx, dists)| {
+                    let bound = seed_dists
+                        .iter()
+                        .zip(dists)
+                        .map(|(s, d)| triangle_lower_bound(*s, *d))
+                        .max()
+                        .unwrap();
+                    (bound, idx)
+                })
+                .collect()
+        };
+        let candidates =
+            EventCandidates::new(events, seed_idx, distance, bounds);
+        LazyNearest::new(candidates, self.approx_factor)
+    }
+
+    fn pivot_dists(&self, idx: usize) -> &[N64] {
+        let npivots = self.pivots.len();
+        &self.dists[idx * npivots..(idx + 1) * npivots]
+    }
+}
+
+/// Search for nearest neighbours using a [PivotTable]
+///
+/// Distances are only computed when the lower bound from the pivot
+/// table is not sufficient.
+pub type Nearest<'a, D, E> = LazyNearest<EventCandidates<'a, D, E>>;
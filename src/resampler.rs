@@ -1,15 +1,23 @@
 use std::cell::RefCell;
+use std::collections::HashSet;
 use std::default::Default;
 use std::rc::Rc;
 
-use crate::cell::Cell;
+use crate::cell::{Cell, Members};
 use crate::cell_collector::CellCollector;
+use crate::compact_events::CompactEvents;
 use crate::distance::{Distance, EuclWithScaledPt};
+use crate::distance_cache::CachedDistance;
 use crate::event::Event;
+use crate::event_store::{EventStore, Events};
+use crate::knn_graph::KnnGraph;
+use crate::pivot_table::PivotTable;
 use crate::progress_bar::{Progress, ProgressBar};
 use crate::seeds::{StrategicSelector, Strategy};
+use crate::signature_buckets::SignatureBuckets;
 use crate::traits::Resample;
 use crate::traits::{ObserveCell, SelectSeeds};
+use crate::vp_tree::VpTree;
 
 use derive_builder::Builder;
 use log::{debug, info, warn};
@@ -25,13 +33,18 @@ pub struct Resampler<D, O, S> {
     observer: O,
     weight_norm: f64,
     max_cell_size: Option<f64>,
+    neighbour_search: NeighbourSearch,
+    concurrent_cells: usize,
+    epsilon: f64,
+    distance_cache: Option<usize>,
 }
 
 impl<D, O, S> Resampler<D, O, S> {
-    fn print_xs(&self, events: &[Event]) {
-        let xs: N64 = events.iter().map(|e| e.weight).sum();
+    fn print_xs(&self, events: &dyn Events) {
+        let weights = (0..events.len()).map(|idx| events.view(idx).weight);
+        let xs: N64 = weights.clone().sum();
         let xs = n64(self.weight_norm) * xs;
-        let sum_wtsqr: N64 = events.iter().map(|e| e.weight * e.weight).sum();
+        let sum_wtsqr: N64 = weights.map(|w| w * w).sum();
         let xs_err = n64(self.weight_norm) * sum_wtsqr.sqrt();
         info!("Initial cross section: σ = {:.3e} ± {:.3e}", xs, xs_err);
     }
@@ -55,35 +68,468 @@ where
         &mut self,
         events: Vec<Event>,
     ) -> Result<Vec<Event>, Self::Error> {
-        self.print_xs(&events);
+        let weights = self.resample_events(&events);
+        let mut events = events;
+        events
+            .par_iter_mut()
+            .zip(weights.par_iter())
+            .for_each(|(event, weight)| event.weight = *weight);
+        Ok(events)
+    }
 
-        let nneg_weight = events.iter().filter(|e| e.weight < 0.).count();
-        let progress = ProgressBar::new(nneg_weight as u64, "events treated:");
+    /// Resampling for events that may be encoded or stored on disk
+    ///
+    /// Events kept in memory are resampled in place. For
+    /// [encoded](crate::event_store::Encoded) events, only the naive
+    /// neighbour search is supported. Each batch of
+    /// [concurrent cells](ResamplerBuilder::concurrent_cells) takes one
+    /// pass over the stored events. The returned encoded events only
+    /// keep their ids and weights, whereas events kept in memory are
+    /// returned in full.
+    fn resample_store(
+        &mut self,
+        store: EventStore,
+    ) -> Result<Vec<Event>, Self::Error> {
+        let store = match store {
+            EventStore::InMemory(mut events) => {
+                let weights = self.resample_events(&events);
+                events.weights_mut().copy_from_slice(&weights);
+                return Ok(events.to_events());
+            }
+            EventStore::Encoded(store) => store,
+        };
+        let events = store.headers();
+        self.print_xs(events);
+        if self.neighbour_search != NeighbourSearch::Naive {
+            warn!("Events are stored in encoded form, using naive neighbour search");
+        }
+        if self.distance_cache.is_some() {
+            info!("Distances are only cached for the tree, pivots, and graph neighbour searches");
+        }
 
         let max_cell_size = n64(self.max_cell_size.unwrap_or(f64::MAX));
 
-        let seeds = self.seeds.select_seeds(&events);
-        let mut events: Vec<_> =
-            events.into_par_iter().map(|e| (n64(0.), e)).collect();
-        for seed in seeds.take(nneg_weight) {
-            if seed >= events.len() {
-                break;
+        let seeds = self.select_seeds(events);
+        let mut weights = events.weights().to_vec();
+        let distance = &self.distance;
+        let select = |batch: &[usize], weights: &[N64]| {
+            let seeds: Vec<_> = batch
+                .iter()
+                .filter(|&&seed| weights[seed] <= 0.)
+                .map(|&seed| {
+                    let event = store.event(seed);
+                    let seed_dist =
+                        distance.distance(event.view(), event.view());
+                    ((seed, seed_dist), (seed, event))
+                })
+                .collect();
+            let (seeds, events): (Vec<_>, Vec<_>) = seeds.into_iter().unzip();
+            let nearest = store.nearest(events, distance, max_cell_size);
+            let mut members =
+                seeds.into_iter().zip(nearest).map(|(seed, nearest)| {
+                    Members::from_nearest(weights, seed, nearest, max_cell_size)
+                });
+            batch
+                .iter()
+                .map(|&seed| {
+                    if weights[seed] > 0. {
+                        None
+                    } else {
+                        members.next()
+                    }
+                })
+                .collect()
+        };
+        resample_cells(
+            &mut self.observer,
+            self.concurrent_cells,
+            events,
+            &mut weights,
+            &seeds,
+            select,
+            None::<fn(usize, &[N64]) -> Members>,
+        );
+
+        Ok(headers(events, weights))
+    }
+}
+
+impl<D, O, S, T> Resampler<D, O, S>
+where
+    D: Distance + Send + Sync,
+    S: SelectSeeds<Iter = T>,
+    T: Iterator<Item = usize>,
+    O: ObserveCell,
+{
+    /// Resample `events` and return the new weights
+    fn resample_events<E: Events>(&mut self, events: &E) -> Vec<N64> {
+        self.print_xs(events);
+
+        let max_cell_size = n64(self.max_cell_size.unwrap_or(f64::MAX));
+
+        let seeds = self.select_seeds(events);
+        // the events are only read during resampling, the current
+        // weights are kept separately
+        let mut weights: Vec<_> = (0..events.len())
+            .into_par_iter()
+            .map(|idx| events.view(idx).weight)
+            .collect();
+        let index = if events.len() < MIN_INDEX_SIZE {
+            SearchIndex::None
+        } else {
+            match self.neighbour_search {
+                NeighbourSearch::Naive => SearchIndex::None,
+                NeighbourSearch::Tree => {
+                    SearchIndex::VpTree(VpTree::new(events, &self.distance))
+                }
+                NeighbourSearch::Pivots => SearchIndex::PivotTable(
+                    PivotTable::new(events, &self.distance, NUM_PIVOTS),
+                ),
+                NeighbourSearch::Graph => SearchIndex::KnnGraph(KnnGraph::new(
+                    events,
+                    &self.distance,
+                    NUM_NEIGHBOURS,
+                )),
+                NeighbourSearch::MixedPrecision => {
+                    match CompactEvents::new(events, &self.distance) {
+                        Some(compact) => SearchIndex::CompactEvents(compact),
+                        None => {
+                            warn!("Mixed-precision search is not supported for this distance, using naive neighbour search");
+                            SearchIndex::None
+                        }
+                    }
+                }
+                NeighbourSearch::Buckets => {
+                    match SignatureBuckets::new(events, &self.distance) {
+                        Some(buckets) => SearchIndex::SignatureBuckets(buckets),
+                        None => {
+                            warn!("Distance does not define type norms, using naive neighbour search");
+                            SearchIndex::None
+                        }
+                    }
+                }
             }
+        };
+        let (index, approximate) = index.with_epsilon(self.epsilon);
+        let distance = &self.distance;
+        let cache_size = if index.caches_distances() {
+            self.distance_cache
+        } else {
+            if self.distance_cache.is_some() {
+                info!("Distances are only cached for the tree, pivots, and graph neighbour searches");
+            }
+            None
+        };
+        let cached = &CachedDistance::new(distance, cache_size);
+        let select = |seeds: &[usize], weights: &[N64]| {
+            seeds
+                .par_iter()
+                .map(|&seed| {
+                    if weights[seed] > 0. {
+                        None
+                    } else {
+                        Some(index.members(
+                            events,
+                            weights,
+                            seed,
+                            distance,
+                            cached,
+                            max_cell_size,
+                        ))
+                    }
+                })
+                .collect()
+        };
+        let exact = |seed, weights: &[N64]| {
+            Members::naive(events, weights, seed, distance, max_cell_size)
+        };
+        resample_cells(
+            &mut self.observer,
+            self.concurrent_cells,
+            events,
+            &mut weights,
+            &seeds,
+            select,
+            approximate.then(|| exact),
+        );
+        if let Some(cache) = cached.cache() {
+            cache.report();
+        }
+        weights
+    }
+
+    fn select_seeds(&mut self, events: &dyn Events) -> Vec<usize> {
+        let nneg_weight = (0..events.len())
+            .filter(|&idx| events.view(idx).weight < 0.)
+            .count();
+        self.seeds
+            .select_seeds(events)
+            .take(nneg_weight)
+            .take_while(|&seed| seed < events.len())
+            .collect()
+    }
+}
+
+/// Events that only keep their id and the given weight
+fn headers(events: &dyn Events, weights: Vec<N64>) -> Vec<Event> {
+    weights
+        .into_par_iter()
+        .enumerate()
+        .map(|(idx, weight)| Event::header(events.view(idx).id(), weight))
+        .collect()
+}
+
+/// Construct and resample cells for all `seeds`
+///
+/// `select` chooses the cell members for a batch of seeds, returning
+/// `None` for seeds with positive weight. If `exact` is given, the
+/// radii of a sample of cells are compared to the ones obtained with
+/// `exact` member selection.
+fn resample_cells<O, S, E>(
+    observer: &mut O,
+    concurrent_cells: usize,
+    events: &dyn Events,
+    weights: &mut [N64],
+    seeds: &[usize],
+    select: S,
+    exact: Option<E>,
+) where
+    O: ObserveCell,
+    S: Fn(&[usize], &[N64]) -> Vec<Option<Members>>,
+    E: Fn(usize, &[N64]) -> Members,
+{
+    let progress = ProgressBar::new(seeds.len() as u64, "events treated:");
+    // compare approximate to exact cell radii for a subset of cells
+    let sample_stride = std::cmp::max(seeds.len() / NUM_RADIUS_SAMPLES, 1);
+    let mut radius_samples = Vec::new();
+    let mut ncells = 0;
+    for batch in seeds.chunks(std::cmp::max(concurrent_cells, 1)) {
+        // Select cell members for all seeds in the batch in
+        // parallel. Selections that overlap with an earlier cell in
+        // the same batch are redone afterwards, so the result is the
+        // same as for sequential cell construction.
+        let selected = if batch.len() > 1 {
+            select(batch, weights)
+        } else {
+            vec![None; batch.len()]
+        };
+        let mut changed = HashSet::new();
+        for (&seed, members) in batch.iter().zip(selected) {
             progress.inc(1);
-            if events[seed].1.weight > 0. {
+            if weights[seed] > 0. {
                 continue;
             }
-            let mut cell =
-                Cell::new(&mut events, seed, &self.distance, max_cell_size);
+            let members = match members {
+                Some(members)
+                    if members.indices().all(|i| !changed.contains(&i)) =>
+                {
+                    members
+                }
+                _ => {
+                    if members.is_some() {
+                        debug!("Cell overlaps with previous one, repeating neighbour search");
+                    }
+                    select(&[seed], weights).pop().flatten().unwrap()
+                }
+            };
+            if let Some(exact) = &exact {
+                if ncells % sample_stride == 0 {
+                    let exact = exact(seed, weights);
+                    radius_samples.push((members.radius(), exact.radius()));
+                }
+            }
+            ncells += 1;
+            changed.extend(members.indices());
+            let mut cell = Cell::from_members(events, weights, members);
             cell.resample();
-            self.observer.observe_cell(&cell);
+            observer.observe_cell(&cell);
         }
-        progress.finish();
-        self.observer.finish();
+    }
+    progress.finish();
+    if !radius_samples.is_empty() {
+        report_radius_drift(radius_samples);
+    }
+    observer.finish();
+}
 
-        let events: Vec<_> =
-            events.into_par_iter().map(|(_dist, event)| event).collect();
-        Ok(events)
+/// Below this number of events we always use a naive neighbour search
+const MIN_INDEX_SIZE: usize = 1024;
+
+/// Number of pivots for [NeighbourSearch::Pivots]
+const NUM_PIVOTS: usize = 16;
+
+/// Number of precomputed neighbours for [NeighbourSearch::Graph]
+const NUM_NEIGHBOURS: usize = 32;
+
+/// Number of cells for which an approximate search is compared to
+/// an exact one
+const NUM_RADIUS_SAMPLES: usize = 100;
+
+enum SearchIndex {
+    None,
+    VpTree(VpTree),
+    PivotTable(PivotTable),
+    SignatureBuckets(SignatureBuckets),
+    KnnGraph(KnnGraph),
+    CompactEvents(CompactEvents),
+}
+
+impl SearchIndex {
+    /// Allow approximate nearest neighbours
+    ///
+    /// Returns whether the search is approximate.
+    fn with_epsilon(self, epsilon: f64) -> (Self, bool) {
+        if epsilon <= 0. {
+            return (self, false);
+        }
+        match self {
+            SearchIndex::VpTree(tree) => {
+                (SearchIndex::VpTree(tree.with_epsilon(epsilon)), true)
+            }
+            SearchIndex::PivotTable(pivots) => {
+                (SearchIndex::PivotTable(pivots.with_epsilon(epsilon)), true)
+            }
+            SearchIndex::SignatureBuckets(buckets) => (
+                SearchIndex::SignatureBuckets(buckets.with_epsilon(epsilon)),
+                true,
+            ),
+            index => {
+                debug!("Approximate search not supported, using exact nearest neighbours");
+                (index, false)
+            }
+        }
+    }
+
+    /// Whether searches reuse distances from a [DistanceCache](crate::distance_cache::DistanceCache)
+    ///
+    /// The other searches compute the distances to most events, which
+    /// are rarely needed again.
+    fn caches_distances(&self) -> bool {
+        matches!(
+            self,
+            SearchIndex::VpTree(_)
+                | SearchIndex::PivotTable(_)
+                | SearchIndex::KnnGraph(_)
+        )
+    }
+
+    /// Select the members of the cell around `seed`
+    ///
+    /// `cached` is used instead of `distance` if the search
+    /// [caches distances](SearchIndex::caches_distances).
+    fn members<E, D, C>(
+        &self,
+        events: &E,
+        weights: &[N64],
+        seed: usize,
+        distance: &D,
+        cached: &C,
+        max_cell_size: N64,
+    ) -> Members
+    where
+        E: Events + ?Sized,
+        D: Distance + Send + Sync,
+        C: Distance + Send + Sync,
+    {
+        match self {
+            SearchIndex::None => {
+                Members::naive(events, weights, seed, distance, max_cell_size)
+            }
+            SearchIndex::VpTree(tree) => Members::with_vp_tree(
+                events,
+                weights,
+                seed,
+                cached,
+                max_cell_size,
+                tree,
+            ),
+            SearchIndex::PivotTable(pivots) => Members::with_pivot_table(
+                events,
+                weights,
+                seed,
+                cached,
+                max_cell_size,
+                pivots,
+            ),
+            SearchIndex::SignatureBuckets(buckets) => {
+                Members::with_signature_buckets(
+                    events,
+                    weights,
+                    seed,
+                    distance,
+                    max_cell_size,
+                    buckets,
+                )
+            }
+            SearchIndex::KnnGraph(graph) => Members::with_knn_graph(
+                events,
+                weights,
+                seed,
+                cached,
+                max_cell_size,
+                graph,
+            ),
+            SearchIndex::CompactEvents(compact) => {
+                Members::with_compact_events(
+                    events,
+                    weights,
+                    seed,
+                    distance,
+                    max_cell_size,
+                    compact,
+                )
+            }
+        }
+    }
+}
+
+/// How to search for the nearest neighbours of cell seeds
+#[derive(Copy, Clone, PartialEq, Eq, PartialOrd, Ord, Hash, Debug)]
+pub enum NeighbourSearch {
+    /// Compute the distances between the seed and all events
+    Naive,
+    /// Use a [vantage-point tree](crate::vp_tree::VpTree)
+    ///
+    /// This is only used for large event samples and gives the same
+    /// result as the naive search if the distance satisfies the
+    /// triangle inequality. Individual cells fall back to the naive
+    /// search if the tree search becomes too expensive.
+    Tree,
+    /// Use the distances to a fixed set of [pivots](crate::pivot_table::PivotTable)
+    /// to skip distance evaluations
+    ///
+    /// This is only used for large event samples and gives the same
+    /// result as the naive search if the distance satisfies the
+    /// triangle inequality.
+    Pivots,
+    /// Group events by the number of particles of each type and
+    /// skip [groups](crate::signature_buckets::SignatureBuckets) that are
+    /// too far away from the seed
+    ///
+    /// This is only used for large event samples and gives the same
+    /// result as the naive search. It requires a distance that
+    /// defines [type norms](crate::distance::Distance::type_norms).
+    Buckets,
+    /// Compute the nearest [neighbours](crate::knn_graph::KnnGraph)
+    /// of all negative-weight events in advance
+    ///
+    /// This is only used for large event samples and gives the same
+    /// result as the naive search. Cells with more members than the
+    /// number of precomputed neighbours fall back to the naive search.
+    Graph,
+    /// Rank candidates by their distance in single precision using a
+    /// [compact copy](crate::compact_events::CompactEvents) of the
+    /// events and only compute exact distances near the cell boundary
+    ///
+    /// This is only used for large event samples and gives the same
+    /// result as the naive search. It requires the
+    /// [EuclWithScaledPt] distance.
+    MixedPrecision,
+}
+
+impl Default for NeighbourSearch {
+    fn default() -> Self {
+        Self::Naive
     }
 }
 
@@ -94,6 +540,10 @@ pub struct ResamplerBuilder<D, O, S> {
     observer: O,
     weight_norm: f64,
     max_cell_size: Option<f64>,
+    neighbour_search: NeighbourSearch,
+    concurrent_cells: usize,
+    epsilon: f64,
+    distance_cache: Option<usize>,
 }
 
 impl<D, O, S> ResamplerBuilder<D, O, S> {
@@ -105,6 +555,10 @@ impl<D, O, S> ResamplerBuilder<D, O, S> {
             observer: self.observer,
             weight_norm: self.weight_norm,
             max_cell_size: self.max_cell_size,
+            neighbour_search: self.neighbour_search,
+            concurrent_cells: self.concurrent_cells,
+            epsilon: self.epsilon,
+            distance_cache: self.distance_cache,
         }
     }
 
@@ -120,6 +574,10 @@ impl<D, O, S> ResamplerBuilder<D, O, S> {
             observer: self.observer,
             weight_norm: self.weight_norm,
             max_cell_size: self.max_cell_size,
+            neighbour_search: self.neighbour_search,
+            concurrent_cells: self.concurrent_cells,
+            epsilon: self.epsilon,
+            distance_cache: self.distance_cache,
         }
     }
 
@@ -134,6 +592,10 @@ impl<D, O, S> ResamplerBuilder<D, O, S> {
             observer: self.observer,
             weight_norm: self.weight_norm,
             max_cell_size: self.max_cell_size,
+            neighbour_search: self.neighbour_search,
+            concurrent_cells: self.concurrent_cells,
+            epsilon: self.epsilon,
+            distance_cache: self.distance_cache,
         }
     }
 
@@ -148,6 +610,10 @@ impl<D, O, S> ResamplerBuilder<D, O, S> {
             observer,
             weight_norm: self.weight_norm,
             max_cell_size: self.max_cell_size,
+            neighbour_search: self.neighbour_search,
+            concurrent_cells: self.concurrent_cells,
+            epsilon: self.epsilon,
+            distance_cache: self.distance_cache,
         }
     }
 
@@ -173,6 +639,67 @@ impl<D, O, S> ResamplerBuilder<D, O, S> {
             ..self
         }
     }
+
+    /// Define how to search for the nearest neighbours of cell seeds
+    ///
+    /// The default is [NeighbourSearch::Naive].
+    pub fn neighbour_search(
+        self,
+        neighbour_search: NeighbourSearch,
+    ) -> ResamplerBuilder<D, O, S> {
+        ResamplerBuilder {
+            neighbour_search,
+            ..self
+        }
+    }
+
+    /// Allow approximate nearest neighbours in cells
+    ///
+    /// Cell members may be up to a factor (1 + `epsilon`) farther away
+    /// from the seed than the exact nearest neighbours. This only
+    /// affects the [Tree](NeighbourSearch::Tree),
+    /// [Pivots](NeighbourSearch::Pivots), and
+    /// [Buckets](NeighbourSearch::Buckets) searches. `epsilon` has to
+    /// be finite and non-negative. The default is 0, meaning exact
+    /// nearest neighbours.
+    pub fn epsilon(self, epsilon: f64) -> ResamplerBuilder<D, O, S> {
+        ResamplerBuilder { epsilon, ..self }
+    }
+
+    /// Number of cells to construct concurrently
+    ///
+    /// Cell members are selected in parallel for batches of this many
+    /// seeds. Cells that overlap with earlier cells in the same batch
+    /// are constructed again, so the result does not depend on this
+    /// setting. The default is 1.
+    pub fn concurrent_cells(
+        self,
+        concurrent_cells: usize,
+    ) -> ResamplerBuilder<D, O, S> {
+        ResamplerBuilder {
+            concurrent_cells,
+            ..self
+        }
+    }
+
+    /// Cache distances between events
+    ///
+    /// Distances are kept in a cache using roughly at most
+    /// `memory_limit` bytes and reused when cells overlap. This is
+    /// mostly useful for expensive distance functions. Distances are
+    /// only cached for the [Tree](NeighbourSearch::Tree),
+    /// [Pivots](NeighbourSearch::Pivots), and
+    /// [Graph](NeighbourSearch::Graph) searches. The default is
+    /// `None`, meaning no distances are cached.
+    pub fn distance_cache(
+        self,
+        memory_limit: Option<usize>,
+    ) -> ResamplerBuilder<D, O, S> {
+        ResamplerBuilder {
+            distance_cache: memory_limit,
+            ..self
+        }
+    }
 }
 
 impl Default
@@ -185,6 +712,10 @@ impl Default
             observer: Default::default(),
             weight_norm: 1.,
             max_cell_size: Default::default(),
+            neighbour_search: Default::default(),
+            concurrent_cells: 1,
+            epsilon: 0.,
+            distance_cache: None,
         }
     }
 }
@@ -196,10 +727,20 @@ pub struct DefaultResampler {
     #[builder(default = "0.")]
     ptweight: f64,
     #[builder(default)]
+    exact_pairing: bool,
+    #[builder(default)]
     strategy: Strategy,
     #[builder(default)]
     max_cell_size: Option<f64>,
     #[builder(default)]
+    neighbour_search: NeighbourSearch,
+    #[builder(default = "1")]
+    concurrent_cells: usize,
+    #[builder(default = "0.")]
+    epsilon: f64,
+    #[builder(default)]
+    distance_cache: Option<usize>,
+    #[builder(default)]
     cell_collector: Option<Rc<RefCell<CellCollector>>>,
 }
 
@@ -210,28 +751,60 @@ impl Resample for DefaultResampler {
         &mut self,
         events: Vec<Event>,
     ) -> Result<Vec<Event>, Self::Error> {
+        self.resampler().resample(events)
+    }
+
+    fn resample_store(
+        &mut self,
+        store: EventStore,
+    ) -> Result<Vec<Event>, Self::Error> {
+        self.resampler().resample_store(store)
+    }
+}
+
+impl DefaultResampler {
+    fn resampler(
+        &self,
+    ) -> Resampler<EuclWithScaledPt, Observer, StrategicSelector> {
         let observer = Observer {
             cell_collector: self.cell_collector.clone(),
             ..Default::default()
         };
 
-        let mut resampler = ResamplerBuilder::default()
+        let distance = EuclWithScaledPt::new(n64(self.ptweight))
+            .with_exact_pairing(self.exact_pairing);
+        ResamplerBuilder::default()
             .seeds(StrategicSelector::new(self.strategy))
-            .distance(EuclWithScaledPt::new(n64(self.ptweight)))
+            .distance(distance)
             .observer(observer)
             .weight_norm(self.weight_norm)
             .max_cell_size(self.max_cell_size)
-            .build();
-        crate::traits::Resample::resample(&mut resampler, events)
+            .neighbour_search(self.neighbour_search)
+            .concurrent_cells(self.concurrent_cells)
+            .epsilon(self.epsilon)
+            .distance_cache(self.distance_cache)
+            .build()
     }
-}
 
-impl DefaultResampler {
     pub fn cell_collector(&self) -> Option<Rc<RefCell<CellCollector>>> {
         self.cell_collector.as_ref().cloned()
     }
 }
 
+fn report_radius_drift(samples: Vec<(N64, N64)>) {
+    let nsamples = samples.len();
+    let (mut approx, mut exact): (Vec<_>, Vec<_>) = samples.into_iter().unzip();
+    let approx = f64::from(median_radius(&mut approx));
+    let exact = f64::from(median_radius(&mut exact));
+    info!(
+        "Median radius of {} sampled cells: {:.3} (exact: {:.3}, drift: {:+.2}%)",
+        nsamples,
+        approx,
+        exact,
+        100. * (approx / exact - 1.)
+    );
+}
+
 fn median_radius(radii: &mut [N64]) -> N64 {
     radii.sort_unstable();
     radii[radii.len() / 2]
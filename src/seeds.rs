@@ -1,4 +1,4 @@
-use crate::event::Event;
+use crate::event_store::Events;
 
 use rayon::prelude::*;
 
@@ -16,7 +16,7 @@ pub trait SelectSeeds {
     /// The return value should be an iterator over the indices of the
     /// seeds in `events`, in the order in which cells are to be
     /// constructed.
-    fn select_seeds(&mut self, events: &[Event]) -> Self::Iter;
+    fn select_seeds(&mut self, events: &dyn Events) -> Self::Iter;
 }
 
 /// Strategy for seeds selection
@@ -52,21 +52,19 @@ impl StrategicSelector {
 impl SelectSeeds for StrategicSelector {
     type Iter = std::vec::IntoIter<usize>;
 
-    fn select_seeds(&mut self, events: &[Event]) -> Self::Iter {
+    fn select_seeds(&mut self, events: &dyn Events) -> Self::Iter {
         use Strategy::*;
-        let mut neg_weight: Vec<_> = events
-            .par_iter()
-            .enumerate()
-            .filter(|(_n, e)| e.weight < 0.)
-            .map(|(n, _e)| n)
+        let mut neg_weight: Vec<_> = (0..events.len())
+            .into_par_iter()
+            .filter(|&n| events.view(n).weight < 0.)
             .collect();
         match self.strategy {
             Next => {}
             MostNegative => {
-                neg_weight.par_sort_unstable_by_key(|&n| events[n].weight)
+                neg_weight.par_sort_unstable_by_key(|&n| events.view(n).weight)
             }
             LeastNegative => neg_weight.par_sort_unstable_by(|&n, &m| {
-                events[m].weight.cmp(&events[n].weight)
+                events.view(m).weight.cmp(&events.view(n).weight)
             }),
         }
         neg_weight.into_iter()
@@ -0,0 +1,206 @@
+use crate::distance::{tolerant_lower_bound, Distance};
+use crate::event_store::Events;
+use crate::nearest::{approx_factor, Candidates, LazyNearest};
+
+use std::cmp::Reverse;
+use std::collections::{BinaryHeap, HashMap};
+
+use log::debug;
+use noisy_float::prelude::*;
+use rayon::prelude::*;
+
+/// Events grouped by their particle type signature
+///
+/// The signature of an event is the number of particles of each
+/// type. For each bucket of events with the same signature, we store
+/// the range of the [type norms](Distance::type_norms) for each
+/// particle type. This gives a cheap lower bound on the distance
+/// between a seed and any event in the bucket. In a
+/// nearest-neighbour search, buckets are visited in order of this
+/// bound and buckets with a bound above the cell radius are skipped.
+#[derive(Clone, Debug)]
+pub struct SignatureBuckets {
+    buckets: Vec<Bucket>,
+    approx_factor: N64,
+}
+
+#[derive(Clone, Debug)]
+struct Bucket {
+    members: Vec<usize>,
+    // particle type and range of the type norm for all members
+    norm_ranges: Vec<(i32, N64, N64)>,
+}
+
+impl SignatureBuckets {
+    /// Group `events` by their signature
+    ///
+    /// Returns `None` if `distance` does not define
+    /// [type norms](Distance::type_norms).
+    pub fn new<E: Events + ?Sized, D: Distance + Sync>(
+        events: &E,
+        distance: &D,
+    ) -> Option<Self> {
+        let norms: Option<Vec<_>> = (0..events.len())
+            .into_par_iter()
+            .map(|idx| {
+                let mut norms = distance.type_norms(events.view(idx))?;
+                norms.sort_unstable_by_key(|(t, _)| *t);
+                Some(norms)
+            })
+            .collect();
+        let norms = norms?;
+        let mut bucket_idx: HashMap<_, usize> = HashMap::new();
+        let mut buckets: Vec<Bucket> = Vec::new();
+        for idx in 0..events.len() {
+            let signature = events.view(idx).signature();
+            let norms = &norms[idx];
+            match bucket_idx.get(&signature) {
+                Some(&n) => buckets[n].add(idx, norms),
+                None => {
+                    bucket_idx.insert(signature, buckets.len());
+                    buckets.push(Bucket::new(idx, norms));
+                }
+            }
+        }
+        debug!("Sorted events into {} signature buckets", buckets.len());
+        Some(Self {
+            buckets,
+            approx_factor: n64(1.),
+        })
+    }
+
+    /// Allow approximate nearest neighbours
+    ///
+    /// The next bucket is only visited if its lower bound times
+    /// (1 + `epsilon`) is below the distance of the next neighbour.
+    pub fn with_epsilon(self, epsilon: f64) -> Self {
+        Self {
+            approx_factor: approx_factor(epsilon),
+            ..self
+        }
+    }
+
+    /// Number of buckets
+    pub fn len(&self) -> usize {
+        self.buckets.len()
+    }
+
+    /// Whether there are no buckets
+    pub fn is_empty(&self) -> bool {
+        self.buckets.is_empty()
+    }
+
+    /// All events except for the seed in order of increasing distance
+    pub fn nearest<'a, E: Events + ?Sized, D: Distance + Sync>(
+        &'a self,
+        events: &'a E,
+        seed_idx: usize,
+        distance: &'a D,
+    ) -> Nearest<'a, D, E> {
+        let seed_norms = distance
+            .type_norms(events.view(seed_idx))
+            .expect("type norms for all events");
+        let mut buckets: Vec<_> = self
+            .buckets
+            .iter()
+            .map(|b| (b.lower_bound(&seed_norms), b))
+            .collect();
+        buckets.sort_unstable_by_key(|(bound, _)| Reverse(*bound));
+        let candidates = BucketCandidates {
+            events,
+            seed_idx,
+            distance,
+            buckets,
+        };
+        LazyNearest::new(candidates, self.approx_factor)
+    }
+}
+
+impl Bucket {
+    fn new(idx: usize, norms: &[(i32, N64)]) -> Self {
+        Self {
+            members: vec![idx],
+            norm_ranges: norms.iter().map(|(t, n)| (*t, *n, *n)).collect(),
+        }
+    }
+
+    fn add(&mut self, idx: usize, norms: &[(i32, N64)]) {
+        self.members.push(idx);
+        for ((t, min, max), (tt, n)) in self.norm_ranges.iter_mut().zip(norms) {
+            debug_assert_eq!(t, tt);
+            *min = std::cmp::min(*min, *n);
+            *max = std::cmp::max(*max, *n);
+        }
+    }
+
+    /// Lower bound on the distance between an event with the given
+    /// type norms and any member of this bucket
+    fn lower_bound(&self, norms: &[(i32, N64)]) -> N64 {
+        let mut bound = 0.;
+        let mut scale = 0.;
+        for (t, min, max) in &self.norm_ranges {
+            let (min, max) = (f64::from(*min), f64::from(*max));
+            let n = norms
+                .iter()
+                .find(|(tt, _)| tt == t)
+                .map(|(_, n)| f64::from(*n))
+                .unwrap_or_default();
+            bound += f64::max(min - n, n - max).max(0.);
+            scale += n + max;
+        }
+        for (t, n) in norms {
+            if !self.norm_ranges.iter().any(|(tt, _, _)| tt == t) {
+                bound += f64::from(*n);
+                scale += f64::from(*n);
+            }
+        }
+        tolerant_lower_bound(bound, scale)
+    }
+}
+
+/// Search for nearest neighbours using [SignatureBuckets]
+///
+/// Distances to the members of a bucket are only computed once the
+/// bucket could contain the next neighbour.
+pub type Nearest<'a, D, E> = LazyNearest<BucketCandidates<'a, D, E>>;
+
+/// Buckets of candidates for a [SignatureBuckets] search
+pub struct BucketCandidates<'a, D, E: ?Sized> {
+    events: &'a E,
+    seed_idx: usize,
+    distance: &'a D,
+    // buckets that have not been visited yet, ordered by decreasing
+    // lower bound on the distance
+    buckets: Vec<(N64, &'a Bucket)>,
+}
+
+impl<'a, D, E> Candidates for BucketCandidates<'a, D, E>
+where
+    D: Distance + Sync,
+    E: Events + ?Sized,
+{
+    fn next_bound(&mut self) -> Option<N64> {
+        self.buckets.last().map(|(bound, _)| *bound)
+    }
+
+    fn visit_next(
+        &mut self,
+        dists: &mut BinaryHeap<Reverse<(N64, usize)>>,
+    ) -> usize {
+        let (_, bucket) = self.buckets.pop().unwrap();
+        let (events, seed_idx) = (self.events, self.seed_idx);
+        let distance = self.distance;
+        let seed = events.view(seed_idx);
+        let bucket_dists: Vec<_> = bucket
+            .members
+            .par_iter()
+            .filter(|&&idx| idx != seed_idx)
+            .map(|&idx| {
+                Reverse((distance.distance(events.view(idx), seed), idx))
+            })
+            .collect();
+        let nevaluations = bucket_dists.len();
+        dists.extend(bucket_dists);
+        nevaluations
+    }
+}
@@ -1,5 +1,8 @@
 use crate::cell::Cell;
 use crate::event::Event;
+use crate::event_store::EventStore;
+
+use noisy_float::prelude::*;
 
 pub use crate::distance::Distance;
 pub use crate::seeds::SelectSeeds;
@@ -26,6 +29,17 @@ pub trait Resample {
     type Error;
 
     fn resample(&mut self, e: Vec<Event>) -> Result<Vec<Event>, Self::Error>;
+
+    /// Resample events from an [EventStore]
+    ///
+    /// The default is to load all events into memory and call
+    /// [resample](Resample::resample).
+    fn resample_store(
+        &mut self,
+        store: EventStore,
+    ) -> Result<Vec<Event>, Self::Error> {
+        self.resample(store.into_events())
+    }
 }
 
 /// Unweight events
@@ -39,18 +53,22 @@ pub trait Unweight {
 ///
 /// When using the [Cres](crate::cres::Cres) class, the Reader originally
 /// used to read the events is passed alongside after a [Rewind]. The
-/// events are guaranteed to be ordered according to their
-/// [id](crate::event::Event::id). Apart from ill-behaved user-defined
-/// conversions, this means they are ordered in the original way they
-/// were read. Apart from its weight, the `Event` with `id == 0`
-/// should correspond to the first event returned by the Reader. This
-/// makes it possible to reconstruct information that is not kept
-/// internally.
+/// new event weights are passed as a table indexed by event
+/// [id](crate::event::Event::id), see
+/// [weights_by_id](crate::event::weights_by_id). Apart from
+/// ill-behaved user-defined conversions, the id is the position of
+/// the event in the Reader, so `weights[0]` is the weight of the
+/// first event returned by the Reader. Entries for events that were
+/// discarded are `None`. This makes it possible to reconstruct
+/// information that is not kept internally.
 pub trait Write<Reader> {
     type Error;
 
-    fn write(&mut self, r: &mut Reader, e: &[Event])
-        -> Result<(), Self::Error>;
+    fn write(
+        &mut self,
+        r: &mut Reader,
+        weights: &[Option<N64>],
+    ) -> Result<(), Self::Error>;
 }
 
 /// Try to clone this object
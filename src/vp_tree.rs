@@ -0,0 +1,286 @@
+use crate::distance::{tolerant_lower_bound, Distance};
+use crate::event_store::Events;
+use crate::nearest::approx_factor;
+
+use std::cmp::{Ordering, Reverse};
+use std::collections::BinaryHeap;
+
+use log::debug;
+use noisy_float::prelude::*;
+use rayon::prelude::*;
+
+/// Subtrees with at most this many events are not split further
+const LEAF_SIZE: usize = 16;
+
+/// Abort a search after computing distances to this fraction of all events
+const MAX_EVALUATION_FRACTION: f64 = 0.5;
+
+/// A vantage-point tree
+///
+/// See P. N. Yianilos, "Data structures and algorithms for nearest
+/// neighbor search in general metric spaces", SODA 1993.
+///
+/// The tree only stores event indices, the events themselves have to
+/// be passed to [nearest](VpTree::nearest). The search is exact if
+/// the distance is symmetric and satisfies the triangle inequality,
+/// unless an approximation is requested with
+/// [with_epsilon](VpTree::with_epsilon).
+#[derive(Debug)]
+pub struct VpTree {
+    root: Node,
+    len: usize,
+    approx_factor: N64,
+}
+
+#[derive(Debug)]
+enum Node {
+    Leaf(Vec<usize>),
+    Inner {
+        vantage_point: usize,
+        inside: Option<Child>,
+        outside: Option<Child>,
+    },
+}
+
+#[derive(Debug)]
+struct Child {
+    node: Box<Node>,
+    // range of distances between the events in `node` and the
+    // vantage point of the parent
+    min_dist: N64,
+    max_dist: N64,
+}
+
+impl VpTree {
+    /// Construct a new tree over all `events`
+    pub fn new<E, D>(events: &E, distance: &D) -> Self
+    where
+        E: Events + ?Sized,
+        D: Distance + Sync,
+    {
+        debug!("Building vantage-point tree over {} events", events.len());
+        let points = (0..events.len()).collect();
+        Self {
+            root: Node::new(events, points, distance),
+            len: events.len(),
+            approx_factor: n64(1.),
+        }
+    }
+
+    /// Allow approximate nearest neighbours
+    ///
+    /// The lower distance bounds of subtrees are scaled up by a factor
+    /// (1 + `epsilon`), so that they are visited later.
+    pub fn with_epsilon(self, epsilon: f64) -> Self {
+        Self {
+            approx_factor: approx_factor(epsilon),
+            ..self
+        }
+    }
+
+    /// Number of events in the tree
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// Whether the tree is empty
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// All events except for the seed in order of increasing distance
+    ///
+    /// The search is aborted if it becomes more expensive than
+    /// computing the distances to all events. This can be checked
+    /// with [Nearest::aborted].
+    pub fn nearest<'a, E: Events + ?Sized, D: Distance>(
+        &'a self,
+        events: &'a E,
+        seed_idx: usize,
+        distance: &'a D,
+    ) -> Nearest<'a, D, E> {
+        debug_assert_eq!(events.len(), self.len);
+        let mut queue = BinaryHeap::new();
+        queue.push(Reverse(QueueItem {
+            dist: n64(0.),
+            entry: Entry::Node(&self.root),
+        }));
+        Nearest {
+            events,
+            seed_idx,
+            distance,
+            queue,
+            nevaluations: 0,
+            max_evaluations: (MAX_EVALUATION_FRACTION * self.len as f64)
+                as usize,
+            aborted: false,
+            approx_factor: self.approx_factor,
+        }
+    }
+}
+
+impl Node {
+    fn new<E: Events + ?Sized, D: Distance + Sync>(
+        events: &E,
+        mut points: Vec<usize>,
+        distance: &D,
+    ) -> Self {
+        if points.len() <= LEAF_SIZE {
+            return Node::Leaf(points);
+        }
+        let vantage_point = points.pop().unwrap();
+        let vp = events.view(vantage_point);
+        let mut dists: Vec<_> = points
+            .into_par_iter()
+            .map(|idx| (distance.distance(events.view(idx), vp), idx))
+            .collect();
+        let median = dists.len() / 2;
+        dists.select_nth_unstable(median);
+        let outside = dists.split_off(median);
+        let (inside, outside) = rayon::join(
+            || Child::new(events, dists, distance),
+            || Child::new(events, outside, distance),
+        );
+        Node::Inner {
+            vantage_point,
+            inside,
+            outside,
+        }
+    }
+}
+
+impl Child {
+    fn new<E: Events + ?Sized, D: Distance + Sync>(
+        events: &E,
+        dists: Vec<(N64, usize)>,
+        distance: &D,
+    ) -> Option<Self> {
+        let min_dist = dists.iter().map(|(d, _)| *d).min()?;
+        let max_dist = dists.iter().map(|(d, _)| *d).max()?;
+        let points = dists.into_iter().map(|(_, idx)| idx).collect();
+        Some(Self {
+            node: Box::new(Node::new(events, points, distance)),
+            min_dist,
+            max_dist,
+        })
+    }
+
+    /// Lower bound on the distance between any event in this subtree
+    /// and an event at distance `dist` from the parent vantage point
+    fn lower_bound(&self, dist: N64) -> N64 {
+        let dist = f64::from(dist);
+        let min_dist = f64::from(self.min_dist);
+        let max_dist = f64::from(self.max_dist);
+        let bound = f64::max(dist - max_dist, min_dist - dist);
+        tolerant_lower_bound(bound, dist + max_dist)
+    }
+}
+
+/// Search for nearest neighbours in a [VpTree]
+///
+/// This iterator yields (distance, index) pairs in order of
+/// increasing distance from the seed. Distances are computed lazily.
+pub struct Nearest<'a, D, E: ?Sized> {
+    events: &'a E,
+    seed_idx: usize,
+    distance: &'a D,
+    queue: BinaryHeap<Reverse<QueueItem<'a>>>,
+    nevaluations: usize,
+    max_evaluations: usize,
+    aborted: bool,
+    approx_factor: N64,
+}
+
+impl<'a, D: Distance, E: Events + ?Sized> Nearest<'a, D, E> {
+    /// Whether the search was aborted
+    ///
+    /// This happens if the number of computed distances exceeds a
+    /// fixed fraction of the number of events.
+    pub fn aborted(&self) -> bool {
+        self.aborted
+    }
+
+    fn dist_to_seed(&mut self, idx: usize) -> N64 {
+        self.nevaluations += 1;
+        self.distance
+            .distance(self.events.view(idx), self.events.view(self.seed_idx))
+    }
+
+    fn push(&mut self, dist: N64, entry: Entry<'a>) {
+        self.queue.push(Reverse(QueueItem { dist, entry }))
+    }
+}
+
+impl<'a, D: Distance, E: Events + ?Sized> Iterator for Nearest<'a, D, E> {
+    type Item = (N64, usize);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        while let Some(Reverse(QueueItem { dist, entry })) = self.queue.pop() {
+            if self.nevaluations > self.max_evaluations {
+                self.aborted = true;
+                return None;
+            }
+            match entry {
+                Entry::Event(idx) => return Some((dist, idx)),
+                Entry::Node(Node::Leaf(points)) => {
+                    for &idx in points {
+                        if idx != self.seed_idx {
+                            let dist = self.dist_to_seed(idx);
+                            self.push(dist, Entry::Event(idx));
+                        }
+                    }
+                }
+                Entry::Node(Node::Inner {
+                    vantage_point,
+                    inside,
+                    outside,
+                }) => {
+                    let vp_dist = self.dist_to_seed(*vantage_point);
+                    if *vantage_point != self.seed_idx {
+                        self.push(vp_dist, Entry::Event(*vantage_point));
+                    }
+                    for child in [inside, outside].into_iter().flatten() {
+                        let bound =
+                            self.approx_factor * child.lower_bound(vp_dist);
+                        let bound = std::cmp::max(dist, bound);
+                        self.push(bound, Entry::Node(&child.node));
+                    }
+                }
+            }
+        }
+        None
+    }
+}
+
+#[derive(Debug)]
+enum Entry<'a> {
+    Event(usize),
+    Node(&'a Node),
+}
+
+// queue items are only compared by their (lower bound on the) distance
+#[derive(Debug)]
+struct QueueItem<'a> {
+    dist: N64,
+    entry: Entry<'a>,
+}
+
+impl<'a> PartialEq for QueueItem<'a> {
+    fn eq(&self, other: &Self) -> bool {
+        self.dist == other.dist
+    }
+}
+
+impl<'a> Eq for QueueItem<'a> {}
+
+impl<'a> PartialOrd for QueueItem<'a> {
+    fn partial_cmp(&self, other: &Self) -> Option<Ordering> {
+        Some(self.cmp(other))
+    }
+}
+
+impl<'a> Ord for QueueItem<'a> {
+    fn cmp(&self, other: &Self) -> Ordering {
+        self.dist.cmp(&other.dist)
+    }
+}
@@ -0,0 +1,191 @@
+// check that distances and cell member searches do not allocate for
+// each candidate event
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::cell::Cell;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+
+use cres::cell::Members;
+use cres::distance::{Distance, EuclWithScaledPt};
+use cres::event::{Event, EventBuilder, EventView};
+use cres::event_store::EventArena;
+use cres::vp_tree::VpTree;
+
+use noisy_float::prelude::*;
+use rand::distributions::{Distribution, Uniform};
+use rand::{Rng, SeedableRng};
+use rand_xoshiro::Xoshiro256Plus;
+
+// count allocations in all threads and in the current thread
+struct CountingAllocator;
+
+static ALLOCATIONS: AtomicUsize = AtomicUsize::new(0);
+
+thread_local! {
+    static THREAD_ALLOCATIONS: Cell<usize> = const { Cell::new(0) };
+}
+
+fn count_allocation() {
+    ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+    let _ = THREAD_ALLOCATIONS.try_with(|n| n.set(n.get() + 1));
+}
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        count_allocation();
+        System.alloc(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(
+        &self,
+        ptr: *mut u8,
+        layout: Layout,
+        new_size: usize,
+    ) -> *mut u8 {
+        count_allocation();
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
+
+// the global allocation count is only meaningful if one test runs at a time
+static SERIAL: Mutex<()> = Mutex::new(());
+
+fn thread_allocations() -> usize {
+    THREAD_ALLOCATIONS.with(|n| n.get())
+}
+
+fn allocations() -> usize {
+    ALLOCATIONS.load(Ordering::Relaxed)
+}
+
+const NEVENTS: usize = 20_000;
+const PT_WEIGHT: f64 = 0.5;
+
+// events with up to `max_set_size` particles of each of two types
+fn random_event<R: Rng>(id: usize, max_set_size: usize, rng: &mut R) -> Event {
+    let multiplicity = Uniform::from(1..=max_set_size);
+    let momentum = Uniform::from(-100.0..100.0);
+    let mut event = EventBuilder::new(id);
+    for pid in [21, 22] {
+        for _ in 0..multiplicity.sample(rng) {
+            let p: [f64; 3] = std::array::from_fn(|_| momentum.sample(rng));
+            let e = (p[0] * p[0] + p[1] * p[1] + p[2] * p[2]).sqrt();
+            event.add_outgoing(
+                pid,
+                [n64(e), n64(p[0]), n64(p[1]), n64(p[2])].into(),
+            );
+        }
+    }
+    event.weight(n64(1.));
+    event.build()
+}
+
+fn random_events(nevents: usize, max_set_size: usize) -> EventArena {
+    let mut rng = Xoshiro256Plus::seed_from_u64(0);
+    let mut events = EventArena::new();
+    for id in 0..nevents {
+        events.push(random_event(id, max_set_size, &mut rng).view());
+    }
+    events
+}
+
+fn all_distances(
+    distance: &EuclWithScaledPt,
+    events: &EventArena,
+    seed: EventView<'_>,
+    views: &[EventView<'_>],
+    dists: &mut [N64],
+) -> N64 {
+    let mut sum = n64(0.);
+    for idx in 0..events.len() {
+        let event = events.view(idx);
+        sum += distance.distance(event, seed);
+        if let Some(dist) = distance.distance_bounded(event, seed, n64(200.)) {
+            sum += dist;
+        }
+    }
+    distance.distance_many(seed, views, dists);
+    sum + dists.iter().copied().sum::<N64>()
+}
+
+#[test]
+fn distances_do_not_allocate() {
+    let _serial = SERIAL.lock().unwrap_or_else(|err| err.into_inner());
+    // sets of more than four particles take a different code path
+    for max_set_size in [4, 6] {
+        let events = random_events(200, max_set_size);
+        let views: Vec<_> =
+            (0..events.len()).map(|idx| events.view(idx)).collect();
+        let mut dists = vec![n64(0.); events.len()];
+        let distance = EuclWithScaledPt::new(n64(PT_WEIGHT));
+        // the first evaluations may set up reusable buffers
+        for idx in 0..events.len() {
+            let seed = events.view(idx);
+            all_distances(&distance, &events, seed, &views, &mut dists);
+        }
+        let before = thread_allocations();
+        let mut sum = n64(0.);
+        for idx in 0..events.len() {
+            let seed = events.view(idx);
+            sum += all_distances(&distance, &events, seed, &views, &mut dists);
+        }
+        assert!(sum > 0.);
+        assert_eq!(thread_allocations() - before, 0);
+    }
+}
+
+// check that `search` allocates much less often than there are candidates
+fn assert_few_allocations<F: FnMut(usize) -> Members>(mut search: F) {
+    const NSEEDS: usize = 10;
+    search(0);
+    let before = allocations();
+    let mut nmembers = 0;
+    for seed_idx in 1..=NSEEDS {
+        nmembers += search(seed_idx).indices().count();
+    }
+    let nallocations = allocations() - before;
+    assert!(nmembers > NSEEDS);
+    assert!(
+        nallocations < NSEEDS * NEVENTS / 20,
+        "{nallocations} allocations for {NSEEDS} searches over {NEVENTS} events"
+    );
+}
+
+#[test]
+fn naive_search_allocations() {
+    let _serial = SERIAL.lock().unwrap_or_else(|err| err.into_inner());
+    let events = random_events(NEVENTS, 4);
+    let weights = vec![n64(-1.); NEVENTS];
+    let distance = EuclWithScaledPt::new(n64(PT_WEIGHT));
+    for max_size in [n64(200.), n64(f64::MAX)] {
+        assert_few_allocations(|seed_idx| {
+            Members::naive(&events, &weights, seed_idx, &distance, max_size)
+        });
+    }
+}
+
+#[test]
+fn vp_tree_search_allocations() {
+    let _serial = SERIAL.lock().unwrap_or_else(|err| err.into_inner());
+    let events = random_events(NEVENTS, 4);
+    let weights = vec![n64(-1.); NEVENTS];
+    let distance = EuclWithScaledPt::new(n64(PT_WEIGHT));
+    let tree = VpTree::new(&events, &distance);
+    assert_few_allocations(|seed_idx| {
+        Members::with_vp_tree(
+            &events,
+            &weights,
+            seed_idx,
+            &distance,
+            n64(200.),
+            &tree,
+        )
+    });
+}
@@ -0,0 +1,129 @@
+// check that the single-precision prefilter gives the same neighbours
+// as the double-precision search for near ties
+use cres::cell::Members;
+use cres::compact_events::CompactEvents;
+use cres::distance::{Distance, EuclWithScaledPt};
+use cres::event::{Event, EventBuilder};
+use cres::event_store::EventArena;
+
+use noisy_float::prelude::*;
+use rand::distributions::{Distribution, Uniform};
+use rand::{Rng, SeedableRng};
+use rand_xoshiro::Xoshiro256Plus;
+
+const PT_WEIGHT: f64 = 0.5;
+
+// relative perturbations from below double precision to well above
+// single precision
+const SCALES: [f64; 6] = [0., 1e-16, 1e-12, 1e-8, 1e-6, 1e-3];
+
+type Momenta = Vec<(i32, [f64; 3])>;
+
+// momenta with up to `max_set_size` particles of each of two types
+fn random_momenta<R: Rng>(
+    max_set_size: usize,
+    magnitude: f64,
+    rng: &mut R,
+) -> Momenta {
+    let multiplicity = Uniform::from(1..=max_set_size);
+    let momentum = Uniform::from(-magnitude..magnitude);
+    let mut momenta = Vec::new();
+    for pid in [21, 22] {
+        for _ in 0..multiplicity.sample(rng) {
+            momenta.push((pid, std::array::from_fn(|_| momentum.sample(rng))));
+        }
+    }
+    momenta
+}
+
+// change each momentum component by a relative amount of at most `scale`
+fn perturbed<R: Rng>(momenta: &Momenta, scale: f64, rng: &mut R) -> Momenta {
+    let factor = Uniform::from(-1.0..1.0);
+    momenta
+        .iter()
+        .map(|(pid, p)| {
+            (*pid, p.map(|p| p * (1. + scale * factor.sample(rng))))
+        })
+        .collect()
+}
+
+fn event(id: usize, momenta: &Momenta) -> Event {
+    let mut event = EventBuilder::new(id);
+    for (pid, p) in momenta {
+        let e = (p[0] * p[0] + p[1] * p[1] + p[2] * p[2]).sqrt();
+        event.add_outgoing(
+            *pid,
+            [n64(e), n64(p[0]), n64(p[1]), n64(p[2])].into(),
+        );
+    }
+    event.weight(n64(1.));
+    event.build()
+}
+
+// groups of events that are all very close to one of a few base events
+fn near_tie_events(max_set_size: usize) -> EventArena {
+    let mut rng = Xoshiro256Plus::seed_from_u64(0);
+    let mut events = EventArena::new();
+    for magnitude in [1e-3, 1e2, 1e6] {
+        for _ in 0..3 {
+            let base = random_momenta(max_set_size, magnitude, &mut rng);
+            for scale in SCALES {
+                for _ in 0..5 {
+                    let momenta = perturbed(&base, scale, &mut rng);
+                    let id = events.len();
+                    events.push(event(id, &momenta).view());
+                }
+            }
+        }
+    }
+    events
+}
+
+#[test]
+fn compact_nearest_matches_double_precision() {
+    // sets of more than four particles take a different code path
+    for max_set_size in [3, 6] {
+        let events = near_tie_events(max_set_size);
+        let distance = EuclWithScaledPt::new(n64(PT_WEIGHT));
+        let compact = CompactEvents::new(&events, &distance).unwrap();
+        for seed_idx in (0..events.len()).step_by(7) {
+            let seed = events.view(seed_idx);
+            let mut expected: Vec<_> = (0..events.len())
+                .filter(|&idx| idx != seed_idx)
+                .map(|idx| (distance.distance(events.view(idx), seed), idx))
+                .collect();
+            expected.sort_unstable();
+            let nearest: Vec<_> =
+                compact.nearest(&events, seed_idx, &distance).collect();
+            assert_eq!(nearest, expected);
+        }
+    }
+}
+
+#[test]
+fn compact_members_match_naive_search() {
+    let mut rng = Xoshiro256Plus::seed_from_u64(1);
+    let weight = Uniform::from(-1.0..1.0);
+    for max_set_size in [3, 6] {
+        let events = near_tie_events(max_set_size);
+        let distance = EuclWithScaledPt::new(n64(PT_WEIGHT));
+        let compact = CompactEvents::new(&events, &distance).unwrap();
+        let mut weights: Vec<_> = (0..events.len())
+            .map(|_| n64(weight.sample(&mut rng)))
+            .collect();
+        for seed_idx in 0..events.len() {
+            let seed_weight = weights[seed_idx];
+            weights[seed_idx] = -seed_weight.abs() - 1.;
+            for max_size in [n64(1e-2), n64(f64::MAX)] {
+                let naive = Members::naive(
+                    &events, &weights, seed_idx, &distance, max_size,
+                );
+                let compact = Members::with_compact_events(
+                    &events, &weights, seed_idx, &distance, max_size, &compact,
+                );
+                assert_eq!(compact, naive);
+            }
+            weights[seed_idx] = seed_weight;
+        }
+    }
+}